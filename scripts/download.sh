@@ -1,5 +1,21 @@
 playlist_title=$(yt-dlp $1 --flat-playlist --dump-single-json | jq -r .title)
 playlist_title_trim=$(echo "$playlist_title" | tr -cd '[:alnum:]')
+store_dir=$3
 
 cd $2
-yt-dlp --extract-audio --audio-format mp3 --embed-thumbnail --add-metadata -o "./$playlist_title_trim/%(playlist_index)s - %(title)s.%(ext)s" $1 --download-archive "./$playlist_title_trim/archive.txt"
+mkdir -p "./$playlist_title_trim"
+
+# Items that are already in the media store are linked instead of downloaded again
+if [ -n "$store_dir" ] && [ -f "$store_dir/ids" ]; then
+  yt-dlp $1 --flat-playlist --print "%(ie_key)s %(id)s %(playlist_index)s - %(title)s" | while read -r extractor id name; do
+    entry="$(echo "$extractor" | tr '[:upper:]' '[:lower:]') $id"
+    grep -qx "$entry" "./$playlist_title_trim/archive.txt" 2>/dev/null && continue
+    hash=$(grep -m1 "^$entry " "$store_dir/ids" | cut -d' ' -f3)
+    [ -n "$hash" ] && [ -f "$store_dir/objects/$hash.mp3" ] || continue
+    name=$(echo "$name" | tr '/' '_')
+    ln "$store_dir/objects/$hash.mp3" "./$playlist_title_trim/$name.mp3" && echo "$entry" >> "./$playlist_title_trim/archive.txt"
+  done
+fi
+
+yt-dlp --extract-audio --audio-format mp3 --embed-thumbnail --add-metadata -o "./$playlist_title_trim/%(playlist_index)s - %(title)s.%(ext)s" $1 --download-archive "./$playlist_title_trim/archive.txt" \
+  --print-to-file "after_move:%(extractor_key)s %(id)s %(filepath)s" "./$playlist_title_trim/ids.txt"
@@ -61,6 +61,17 @@ extern "C" {
 #define PLAYLIST_FILE_THUMBNAIL_COLOR GRAY
 #define PLAYLIST_FILE_THUMBNAIL_SIZE (vec2s){48, 48}
 
+// Thumbnail pyramid levels (longest edge in pixels)
+#define THUMBNAIL_ROW_SIZE 48
+#define THUMBNAIL_GRID_SIZE 144
+#define THUMBNAIL_CARD_SIZE 180
+
+// Cells per axis of the color grid that is painted until a cover is uploaded
+#define THUMBNAIL_PLACEHOLDER_SIZE 4
+
+// Levels that are built while loading a playlist (rows + search grid)
+#define PLAYLIST_FILE_THUMBNAIL_LEVELS (THUMBNAIL_LEVEL_BIT(ThumbnailLevel::Row) | THUMBNAIL_LEVEL_BIT(ThumbnailLevel::Grid))
+
 // Volume
 #define VOLUME_TOGGLE_STEP 5
 #define VOLUME_MAX 100.0f 
@@ -124,3 +135,26 @@ inline LfTheme ui_theme() {
 // Async loading
 #define ASYNC_PLAYLIST_LOADING true 
 #define MIN_FILES_FOR_ASYNC 10
+#define WARM_PLAYLISTS_ON_START true // Favourites and the last played playlist load in the background at startup
+#define PROCESS_POLL_INTERVAL 0.5f // Seconds between checks for running downloads, they fork a shell
+#define TRACK_LOADER_IO_TASKS 4 // Tracks that are stat'ed and read from the tile cache at the same time
+#define TRACK_LOADER_QUEUE_SIZE 32 // Tracks a loader stage may hand to the next one before it waits
+#define TRACK_LOADER_UPLOAD_QUEUE_SIZE 64 // Decoded covers that may wait for their upload
+#define THUMBNAIL_UPLOAD_BUDGET 0.002f // Seconds per frame covers are uploaded for, adapted to the frame time
+#define THUMBNAIL_UPLOAD_BUDGET_MIN 0.0005f
+#define THUMBNAIL_UPLOAD_BUDGET_MAX 0.004f
+
+// Duplicate detection
+#define FINGERPRINT_SAMPLE_RATE 11025
+#define FINGERPRINT_FRAME_SIZE 2048 // Power of two
+#define FINGERPRINT_FRAME_HOP 1024
+#define FINGERPRINT_FRAME_COUNT 128
+#define FINGERPRINT_MIN_FREQ 300.0f
+#define FINGERPRINT_MAX_FREQ 2000.0f
+#define FINGERPRINT_MATCH_BER 0.30f // Max. ratio of differing bits for two tracks to count as duplicates
+#define FINGERPRINT_MAX_DURATION_DIFF 3.0f
+
+// Playlist journal
+#define PLAYLIST_JOURNAL_COMPACT_SIZE (256 * 1024) // Bytes after which the journal is folded into the playlist file
+#define PLAYLIST_JOURNAL_SYNC_INTERVAL 1.0f // Seconds between fsyncs of the journals
+#define PLAYLIST_WRITE_DELAY 0.25f // Seconds full playlist rewrites are coalesced for
@@ -0,0 +1,576 @@
+#include "duplicateFinder.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "playlists.hpp"
+#include "threadPool.hpp"
+
+#include <miniaudio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LYSSA_FINGERPRINT_SSE2
+#endif
+
+// 33 bands give 32 energy differences, one bit each
+#define FINGERPRINT_BANDS 33
+#define FINGERPRINT_MAX_OFFSET 2 // Frames the windows of two encodes may be shifted by
+#define FINGERPRINT_MAX_BUCKET 64 // Sub-fingerprints shared by more tracks are too common to be useful
+#define FINGERPRINT_CHUNK_SIZE 4 // Tracks per pool task
+#define FINGERPRINT_STORE_MAGIC 0x5046594c // "LYFP"
+#define FINGERPRINT_STORE_VERSION 1
+
+namespace {
+  struct Fingerprint {
+    std::string path;
+    uintmax_t fileSize;
+    int64_t mtime;
+    float duration;
+    // One sub-fingerprint per frame, empty if the track could not be decoded
+    std::vector<uint32_t> frames;
+  };
+
+  // Tables and scratch buffers of one worker
+  struct Analyzer {
+    std::vector<float> window;
+    std::vector<float> cosTable, sinTable;
+    std::vector<uint32_t> bitReverse;
+    uint32_t bandEdges[FINGERPRINT_BANDS + 1];
+    std::vector<float> re, im, power;
+  };
+
+  std::future<void> job;
+  std::atomic<bool> cancelled{false}, running{false}, finished{false};
+  std::mutex resultMutex;
+  std::vector<DuplicateCluster> result;
+
+  std::filesystem::path storePath() {
+    return LYSSA_DIR + "/cache/fingerprints";
+  }
+
+  std::filesystem::path reportPath() {
+    return LYSSA_DIR + "/cache/duplicates.txt";
+  }
+
+  Analyzer createAnalyzer() {
+    const uint32_t n = FINGERPRINT_FRAME_SIZE;
+    Analyzer a;
+    a.window.resize(n);
+    for(uint32_t i = 0; i < n; i++) {
+      a.window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (n - 1));
+    }
+    a.cosTable.resize(n / 2);
+    a.sinTable.resize(n / 2);
+    for(uint32_t k = 0; k < n / 2; k++) {
+      a.cosTable[k] = cosf(2.0f * (float)M_PI * k / n);
+      a.sinTable[k] = -sinf(2.0f * (float)M_PI * k / n);
+    }
+    uint32_t bits = 0;
+    while((1u << bits) < n) bits++;
+    a.bitReverse.resize(n);
+    for(uint32_t i = 0; i < n; i++) {
+      uint32_t r = 0;
+      for(uint32_t b = 0; b < bits; b++) {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      a.bitReverse[i] = r;
+    }
+    // Logarithmically spaced bands, every band covers at least one bin
+    for(uint32_t b = 0; b <= FINGERPRINT_BANDS; b++) {
+      float freq = FINGERPRINT_MIN_FREQ * powf(FINGERPRINT_MAX_FREQ / FINGERPRINT_MIN_FREQ, (float)b / FINGERPRINT_BANDS);
+      uint32_t bin = (uint32_t)lroundf(freq * n / FINGERPRINT_SAMPLE_RATE);
+      a.bandEdges[b] = (b > 0 && bin <= a.bandEdges[b - 1]) ? a.bandEdges[b - 1] + 1 : bin;
+    }
+    a.re.resize(n);
+    a.im.resize(n);
+    a.power.resize(n / 2);
+    return a;
+  }
+
+  void downmix(const float* stereo, size_t frames, float* mono) {
+    size_t i = 0;
+#ifdef LYSSA_FINGERPRINT_SSE2
+    const __m128 half = _mm_set1_ps(0.5f);
+    for(; i + 4 <= frames; i += 4) {
+      __m128 a = _mm_loadu_ps(stereo + i * 2);
+      __m128 b = _mm_loadu_ps(stereo + i * 2 + 4);
+      __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(mono + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+    }
+#endif
+    for(; i < frames; i++) {
+      mono[i] = (stereo[i * 2] + stereo[i * 2 + 1]) * 0.5f;
+    }
+  }
+
+  void applyWindow(const float* samples, const float* window, float* dst, size_t n) {
+    size_t i = 0;
+#ifdef LYSSA_FINGERPRINT_SSE2
+    for(; i + 4 <= n; i += 4) {
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(window + i)));
+    }
+#endif
+    for(; i < n; i++) {
+      dst[i] = samples[i] * window[i];
+    }
+  }
+
+  void powerSpectrum(const float* re, const float* im, float* power, size_t n) {
+    size_t i = 0;
+#ifdef LYSSA_FINGERPRINT_SSE2
+    for(; i + 4 <= n; i += 4) {
+      __m128 r = _mm_loadu_ps(re + i);
+      __m128 m = _mm_loadu_ps(im + i);
+      _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+#endif
+    for(; i < n; i++) {
+      power[i] = re[i] * re[i] + im[i] * im[i];
+    }
+  }
+
+  // Iterative radix-2 FFT of a.re/a.im in place
+  void fft(Analyzer& a) {
+    const uint32_t n = FINGERPRINT_FRAME_SIZE;
+    for(uint32_t i = 0; i < n; i++) {
+      uint32_t j = a.bitReverse[i];
+      if(i < j) {
+        std::swap(a.re[i], a.re[j]);
+        std::swap(a.im[i], a.im[j]);
+      }
+    }
+    for(uint32_t size = 2; size <= n; size <<= 1) {
+      uint32_t half = size / 2, step = n / size;
+      for(uint32_t start = 0; start < n; start += size) {
+        for(uint32_t k = 0; k < half; k++) {
+          float wr = a.cosTable[k * step], wi = a.sinTable[k * step];
+          uint32_t i = start + k, j = i + half;
+          float tr = wr * a.re[j] - wi * a.im[j];
+          float ti = wr * a.im[j] + wi * a.re[j];
+          a.re[j] = a.re[i] - tr;
+          a.im[j] = a.im[i] - ti;
+          a.re[i] += tr;
+          a.im[i] += ti;
+        }
+      }
+    }
+  }
+
+  bool computeFingerprint(Analyzer& a, Fingerprint& fp) {
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 2, FINGERPRINT_SAMPLE_RATE);
+    ma_decoder decoder;
+    if(ma_decoder_init_file(fp.path.c_str(), &config, &decoder) != MA_SUCCESS) {
+      return false;
+    }
+    ma_uint64 length = 0;
+    ma_decoder_get_length_in_pcm_frames(&decoder, &length);
+    fp.duration = (float)length / FINGERPRINT_SAMPLE_RATE;
+
+    // One more frame than sub-fingerprints, each bit compares against the previous frame
+    const ma_uint64 needed = (ma_uint64)FINGERPRINT_FRAME_COUNT * FINGERPRINT_FRAME_HOP + FINGERPRINT_FRAME_SIZE;
+    if(length < needed) {
+      ma_decoder_uninit(&decoder);
+      return false;
+    }
+    // The middle of a track does not depend on leading silence or intros
+    ma_decoder_seek_to_pcm_frame(&decoder, (length - needed) / 2);
+    std::vector<float> stereo(needed * 2), mono(needed);
+    ma_uint64 read = 0;
+    ma_decoder_read_pcm_frames(&decoder, stereo.data(), needed, &read);
+    ma_decoder_uninit(&decoder);
+    if(read < needed) {
+      return false;
+    }
+    downmix(stereo.data(), needed, mono.data());
+
+    float prev[FINGERPRINT_BANDS], cur[FINGERPRINT_BANDS];
+    fp.frames.clear();
+    fp.frames.reserve(FINGERPRINT_FRAME_COUNT);
+    for(uint32_t f = 0; f <= FINGERPRINT_FRAME_COUNT; f++) {
+      if(cancelled) return false;
+      applyWindow(mono.data() + (size_t)f * FINGERPRINT_FRAME_HOP, a.window.data(), a.re.data(), FINGERPRINT_FRAME_SIZE);
+      std::fill(a.im.begin(), a.im.end(), 0.0f);
+      fft(a);
+      powerSpectrum(a.re.data(), a.im.data(), a.power.data(), a.power.size());
+
+      for(uint32_t b = 0; b < FINGERPRINT_BANDS; b++) {
+        float energy = 0.0f;
+        for(uint32_t k = a.bandEdges[b]; k < a.bandEdges[b + 1]; k++) {
+          energy += a.power[k];
+        }
+        cur[b] = energy;
+      }
+      if(f > 0) {
+        uint32_t bits = 0;
+        for(uint32_t m = 0; m < FINGERPRINT_BANDS - 1; m++) {
+          if((cur[m] - cur[m + 1]) - (prev[m] - prev[m + 1]) > 0.0f) {
+            bits |= 1u << m;
+          }
+        }
+        fp.frames.emplace_back(bits);
+      }
+      memcpy(prev, cur, sizeof(cur));
+    }
+    return true;
+  }
+
+  void writeRecord(FILE* file, const Fingerprint& fp) {
+    uint32_t pathLen = (uint32_t)fp.path.size();
+    uint64_t fileSize = fp.fileSize;
+    uint32_t count = (uint32_t)fp.frames.size();
+    fwrite(&pathLen, sizeof(pathLen), 1, file);
+    fwrite(fp.path.data(), 1, pathLen, file);
+    fwrite(&fileSize, sizeof(fileSize), 1, file);
+    fwrite(&fp.mtime, sizeof(fp.mtime), 1, file);
+    fwrite(&fp.duration, sizeof(fp.duration), 1, file);
+    fwrite(&count, sizeof(count), 1, file);
+    fwrite(fp.frames.data(), sizeof(uint32_t), count, file);
+  }
+
+  // Reads every complete record, a record cut off by a crash ends the store
+  std::unordered_map<std::string, Fingerprint> loadStore(uint32_t* recordCount) {
+    std::unordered_map<std::string, Fingerprint> store;
+    *recordCount = 0;
+    FILE* file = fopen(storePath().c_str(), "rb");
+    if(!file) return store;
+
+    uint32_t header[2];
+    if(fread(header, sizeof(header), 1, file) != 1 ||
+        header[0] != FINGERPRINT_STORE_MAGIC || header[1] != FINGERPRINT_STORE_VERSION) {
+      fclose(file);
+      return store;
+    }
+    for(;;) {
+      Fingerprint fp;
+      uint32_t pathLen, count;
+      uint64_t fileSize;
+      if(fread(&pathLen, sizeof(pathLen), 1, file) != 1 || pathLen == 0 || pathLen > 4096) break;
+      fp.path.resize(pathLen);
+      if(fread(&fp.path[0], 1, pathLen, file) != pathLen) break;
+      if(fread(&fileSize, sizeof(fileSize), 1, file) != 1) break;
+      if(fread(&fp.mtime, sizeof(fp.mtime), 1, file) != 1) break;
+      if(fread(&fp.duration, sizeof(fp.duration), 1, file) != 1) break;
+      if(fread(&count, sizeof(count), 1, file) != 1 || count > FINGERPRINT_FRAME_COUNT) break;
+      fp.frames.resize(count);
+      if(fread(fp.frames.data(), sizeof(uint32_t), count, file) != count) break;
+      fp.fileSize = fileSize;
+      store[fp.path] = fp;
+      (*recordCount)++;
+    }
+    fclose(file);
+    return store;
+  }
+
+  FILE* openStore(bool truncate) {
+    std::error_code ec;
+    std::filesystem::create_directories(storePath().parent_path(), ec);
+
+    uint32_t header[2] = {0, 0};
+    if(!truncate) {
+      FILE* file = fopen(storePath().c_str(), "rb");
+      if(file) {
+        if(fread(header, sizeof(header), 1, file) != 1) header[0] = 0;
+        fclose(file);
+      }
+    }
+    if(header[0] == FINGERPRINT_STORE_MAGIC && header[1] == FINGERPRINT_STORE_VERSION) {
+      return fopen(storePath().c_str(), "ab");
+    }
+    FILE* file = fopen(storePath().c_str(), "wb");
+    if(!file) {
+      LOG_ERROR("Failed to open the fingerprint store '%s'.", storePath().c_str());
+      return NULL;
+    }
+    header[0] = FINGERPRINT_STORE_MAGIC;
+    header[1] = FINGERPRINT_STORE_VERSION;
+    fwrite(header, sizeof(header), 1, file);
+    return file;
+  }
+
+  float bitErrorRate(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    float best = 1.0f;
+    for(int32_t offset = -FINGERPRINT_MAX_OFFSET; offset <= FINGERPRINT_MAX_OFFSET; offset++) {
+      uint32_t errors = 0, compared = 0;
+      for(int32_t i = std::max(0, -offset); i < (int32_t)a.size() && i + offset < (int32_t)b.size(); i++) {
+        errors += __builtin_popcount(a[i] ^ b[i + offset]);
+        compared++;
+      }
+      if(compared) {
+        best = std::min(best, (float)errors / (compared * (FINGERPRINT_BANDS - 1)));
+      }
+    }
+    return best;
+  }
+
+  uint32_t findRoot(std::vector<uint32_t>& parent, uint32_t i) {
+    while(parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  std::vector<DuplicateCluster> findClusters(const std::vector<Fingerprint>& fingerprints) {
+    // Sub-fingerprint -> tracks containing it. Two encodes of the same song
+    // share at least one sub-fingerprint exactly, so only those get compared.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> index;
+    for(uint32_t i = 0; i < fingerprints.size(); i++) {
+      for(uint32_t frame : fingerprints[i].frames) {
+        if(frame == 0 || frame == UINT32_MAX) continue;
+        std::vector<uint32_t>& bucket = index[frame];
+        if(bucket.empty() || bucket.back() != i) {
+          bucket.emplace_back(i);
+        }
+      }
+    }
+
+    std::vector<uint32_t> parent(fingerprints.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    std::vector<uint32_t> candidates;
+    for(uint32_t i = 0; i < fingerprints.size(); i++) {
+      candidates.clear();
+      for(uint32_t frame : fingerprints[i].frames) {
+        auto it = index.find(frame);
+        if(it == index.end() || it->second.size() > FINGERPRINT_MAX_BUCKET) continue;
+        for(uint32_t j : it->second) {
+          if(j > i) candidates.emplace_back(j);
+        }
+      }
+      std::sort(candidates.begin(), candidates.end());
+      candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+      for(uint32_t j : candidates) {
+        if(fabsf(fingerprints[i].duration - fingerprints[j].duration) > FINGERPRINT_MAX_DURATION_DIFF) continue;
+        if(findRoot(parent, i) == findRoot(parent, j)) continue;
+        if(bitErrorRate(fingerprints[i].frames, fingerprints[j].frames) <= FINGERPRINT_MATCH_BER) {
+          parent[findRoot(parent, j)] = findRoot(parent, i);
+        }
+      }
+    }
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> groups;
+    for(uint32_t i = 0; i < fingerprints.size(); i++) {
+      if(!fingerprints[i].frames.empty()) {
+        groups[findRoot(parent, i)].emplace_back(i);
+      }
+    }
+    std::vector<DuplicateCluster> clusters;
+    for(const auto& [root, members] : groups) {
+      if(members.size() < 2) continue;
+      DuplicateCluster cluster{};
+      uintmax_t total = 0, largest = 0;
+      for(uint32_t i : members) {
+        cluster.paths.emplace_back(fingerprints[i].path);
+        total += fingerprints[i].fileSize;
+        largest = std::max(largest, fingerprints[i].fileSize);
+      }
+      cluster.reclaimableBytes = total - largest;
+      clusters.emplace_back(cluster);
+    }
+    std::sort(clusters.begin(), clusters.end(), [](const DuplicateCluster& a, const DuplicateCluster& b) {
+        return a.reclaimableBytes > b.reclaimableBytes;
+        });
+    return clusters;
+  }
+
+  void writeReport(const std::vector<DuplicateCluster>& clusters) {
+    std::ofstream report(reportPath());
+    if(!report.is_open()) {
+      LOG_ERROR("Failed to write the duplicate report '%s'.", reportPath().c_str());
+      return;
+    }
+    uintmax_t reclaimable = 0;
+    for(const auto& cluster : clusters) {
+      reclaimable += cluster.reclaimableBytes;
+    }
+    report << "# " << clusters.size() << " duplicate clusters, " << reclaimable / (1024 * 1024) << " MB reclaimable\n";
+    for(const auto& cluster : clusters) {
+      report << "\n";
+      for(const auto& path : cluster.paths) {
+        report << path.string() << "\n";
+      }
+    }
+  }
+
+  // State of one run, shared by its chunk tasks
+  struct Run {
+    std::vector<Fingerprint> fingerprints;
+    std::vector<uint32_t> pending;
+    uint32_t recordCount = 0, reused = 0;
+    FILE* storeFile = NULL;
+    std::mutex storeMutex;
+    std::atomic<uint32_t> next{0};
+    // Chains of chunk tasks that are still running, the last one finishes the run
+    std::atomic<uint32_t> chains{0};
+    std::promise<void> done;
+  };
+
+  void finishRun(Run& run) {
+    if(run.storeFile) fclose(run.storeFile);
+
+    if(!cancelled) {
+      // Drop records of removed, changed or repeated tracks
+      if(run.recordCount > run.reused) {
+        FILE* file = openStore(true);
+        if(file) {
+          for(const auto& fp : run.fingerprints) {
+            writeRecord(file, fp);
+          }
+          fclose(file);
+        }
+      }
+
+      std::vector<DuplicateCluster> clusters = findClusters(run.fingerprints);
+      writeReport(clusters);
+      {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result = clusters;
+      }
+      finished = true;
+    }
+    running = false;
+    run.done.set_value();
+  }
+
+  // Fingerprints a few tracks and queues the next chunk as a new task, so
+  // the workers pick up tasks of higher priority between the chunks
+  void fingerprintChunk(std::shared_ptr<Run> run) {
+    thread_local Analyzer analyzer = createAnalyzer();
+    bool more = true;
+    for(uint32_t i = 0; i < FINGERPRINT_CHUNK_SIZE && more; i++) {
+      uint32_t n = run->next++;
+      more = n < run->pending.size() && !cancelled;
+      if(!more) break;
+      Fingerprint& fp = run->fingerprints[run->pending[n]];
+      if(!computeFingerprint(analyzer, fp)) {
+        if(cancelled) break;
+        // Stored anyway so undecodable tracks are not retried every run
+        fp.frames.clear();
+      }
+      std::lock_guard<std::mutex> lock(run->storeMutex);
+      if(run->storeFile) {
+        writeRecord(run->storeFile, fp);
+        fflush(run->storeFile);
+      }
+    }
+    if(more && !cancelled) {
+      ThreadPool::submit([run]() { fingerprintChunk(run); }, TaskPriority::Low);
+      return;
+    }
+    if(--run->chains == 0) {
+      finishRun(*run);
+    }
+  }
+
+  void startRun(std::shared_ptr<Run> run, const std::vector<std::filesystem::path>& playlistDirs) {
+    std::vector<std::filesystem::path> tracks = DuplicateFinder::collectLibrary(playlistDirs);
+    std::unordered_map<std::string, Fingerprint> store = loadStore(&run->recordCount);
+
+    run->fingerprints.reserve(tracks.size());
+    for(const auto& path : tracks) {
+      std::error_code ec;
+      Fingerprint fp{};
+      fp.path = path.string();
+      fp.fileSize = std::filesystem::file_size(path, ec);
+      if(ec) continue;
+      fp.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+      if(ec) continue;
+
+      auto it = store.find(fp.path);
+      if(it != store.end() && it->second.fileSize == fp.fileSize && it->second.mtime == fp.mtime) {
+        run->fingerprints.emplace_back(it->second);
+        run->reused++;
+      } else {
+        run->pending.emplace_back((uint32_t)run->fingerprints.size());
+        run->fingerprints.emplace_back(fp);
+      }
+    }
+    store.clear();
+
+    // Every finished track is appended right away, so a cancelled or
+    // crashed run resumes where it stopped
+    run->storeFile = openStore(false);
+    uint32_t chunks = (run->pending.size() + FINGERPRINT_CHUNK_SIZE - 1) / FINGERPRINT_CHUNK_SIZE;
+    uint32_t chains = std::min(chunks, ThreadPool::getWorkerCount());
+    if(chains == 0 || cancelled) {
+      finishRun(*run);
+      return;
+    }
+    run->chains = chains;
+    for(uint32_t i = 0; i < chains; i++) {
+      ThreadPool::submit([run]() { fingerprintChunk(run); }, TaskPriority::Low);
+    }
+  }
+}
+
+namespace DuplicateFinder {
+  std::vector<std::filesystem::path> collectLibrary(const std::vector<std::filesystem::path>& playlistDirs) {
+    std::set<std::string> seen;
+    std::vector<std::filesystem::path> tracks;
+    std::error_code ec;
+
+    for(const auto& dir : playlistDirs) {
+      for(const auto& path : PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(dir, ec))) {
+        if(seen.insert(path).second) {
+          tracks.emplace_back(path);
+        }
+      }
+    }
+
+    for(const auto& entry : std::filesystem::recursive_directory_iterator(LYSSA_DIR + "/downloaded_playlists/",
+          std::filesystem::directory_options::skip_permission_denied, ec)) {
+      std::string ext = entry.path().extension().string();
+      // Formats miniaudio decodes
+      if(!entry.is_regular_file() || (ext != ".mp3" && ext != ".flac" && ext != ".wav")) continue;
+      if(seen.insert(entry.path().string()).second) {
+        tracks.emplace_back(entry.path());
+      }
+    }
+    return tracks;
+  }
+
+  void start(const std::vector<std::filesystem::path>& playlistDirs) {
+    if(running) return;
+    if(job.valid()) {
+      job.wait();
+    }
+    cancelled = false;
+    finished = false;
+    running = true;
+    auto run = std::make_shared<Run>();
+    job = run->done.get_future();
+    ThreadPool::submit([run, playlistDirs]() { startRun(run, playlistDirs); }, TaskPriority::Low);
+  }
+
+  bool isRunning() {
+    return running;
+  }
+
+  bool pollFinished(std::vector<DuplicateCluster>& clusters) {
+    if(!finished.exchange(false)) return false;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    clusters = result;
+    return true;
+  }
+
+  void stop() {
+    cancelled = true;
+    if(job.valid()) {
+      job.wait();
+    }
+  }
+}
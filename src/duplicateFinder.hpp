@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <stdint.h>
+#include <vector>
+
+struct DuplicateCluster {
+  std::vector<std::filesystem::path> paths;
+  // Size of every file in the cluster except the largest one
+  uintmax_t reclaimableBytes;
+};
+
+// Finds tracks of the library that are the same song, even if they are
+// encoded or tagged differently. Every track gets an acoustic fingerprint
+// (32 band-energy bits per ~93ms frame of a 12s window from the middle of
+// the track) that is stored in ~/.lyssa/cache/fingerprints, so a run only
+// decodes tracks that are new or changed since the last one.
+namespace DuplicateFinder {
+  // All tracks of the playlists and the downloaded playlists, reads every
+  // playlist file
+  std::vector<std::filesystem::path> collectLibrary(const std::vector<std::filesystem::path>& playlistDirs);
+
+  // Collects the library of the playlists and fingerprints its tracks in
+  // small Low priority tasks, then clusters duplicates. The clusters are
+  // written to ~/.lyssa/cache/duplicates.txt
+  void start(const std::vector<std::filesystem::path>& playlistDirs);
+
+  bool isRunning();
+
+  // Returns true once after a run finished
+  bool pollFinished(std::vector<DuplicateCluster>& clusters);
+
+  // Cancels a running job. Fingerprints computed so far are kept.
+  void stop();
+}
@@ -4,7 +4,8 @@ GlobalState state = {
   .win = NULL,
   .deltaTime = 0.0f,
   .lastTime = 0.0f,
-  .currentSoundFile = NULL,
+  .currentTrack = TRACK_ID_NONE,
+  .previousTrack = TRACK_ID_NONE,
   .skipDownAmount = 1,
   .currentPlaylist = -1, 
   .playingPlaylist = -1,
@@ -19,7 +20,7 @@ GlobalState state = {
 
   .playlistDownloadRunning = false, 
   .playlistDownloadFinished = false,
-  .playlistThumbnailDownloadIndex = -1, 
+  .playlistThumbnailDownload = PLAYLIST_HANDLE_NONE, 
 
 };
 
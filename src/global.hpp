@@ -7,6 +7,7 @@
 #include "popups.hpp"
 #include "playlists.hpp"
 #include "infoCard.hpp"
+#include "imageScaler.hpp"
 
 #include <memory>
 #include <string>
@@ -14,6 +15,7 @@
 #include <vector>
 #include <functional>
 #include <future>
+#include <atomic>
 #include <filesystem>
 #include <miniaudio.h>
 
@@ -71,13 +73,13 @@ struct TrackFullscreenTab {
 };
 
 struct OnTrackTab {
-  LfTexture trackThumbnail;
+  // The cover is owned by the ThumbnailCache
+  std::filesystem::path trackThumbnailPath;
 };
 
 struct PlaylistAddFromFolderTab {
   std::vector<std::filesystem::directory_entry> folderContents;
   std::string currentFolderPath;
-  bool addedFile;
 };
 
 enum class PopupID {
@@ -95,7 +97,8 @@ struct GlobalState {
   SoundHandler soundHandler;
   InfoCardHandler infoCards;
 
-  SoundFile* currentSoundFile = NULL, *previousSoundFile = NULL;
+  // Handles into the TrackTable, TRACK_ID_NONE if no track is shown
+  TrackId currentTrack = TRACK_ID_NONE, previousTrack = TRACK_ID_NONE;
   int32_t currentSoundPos, previousSoundPos;
 
   LfFont musicTitleFont,
@@ -138,17 +141,8 @@ struct GlobalState {
   float volumeBeforeMute;
 
 
-  // Async loading
-  std::vector<std::future<void>> playlistFileFutures;
-  std::vector<std::future<void>> playlistFutures;
-  std::vector<std::string> loadedPlaylistFilepaths;
-  std::vector<TextureData> playlistFileThumbnailData;
-  std::vector<TextureData> playlistThumbnailData;
-  std::mutex mutex;
-
-
   bool playlistDownloadRunning, playlistDownloadFinished;
-  int32_t playlistThumbnailDownloadIndex;
+  PlaylistHandle playlistThumbnailDownload;
 
   std::string downloadingPlaylistName;
   uint32_t downloadPlaylistFileCount;
@@ -156,7 +150,7 @@ struct GlobalState {
   bool shuffle, replayTrack;
 
   InputField searchPlaylistInput;
-  std::vector<SoundFile> searchPlaylistResults;
+  std::vector<TrackId> searchPlaylistResults;
 };
 
 extern GlobalState state;
@@ -0,0 +1,304 @@
+#include "imageScaler.hpp"
+#include "config.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LYSSA_IMAGE_SCALER_SSE2
+#endif
+
+namespace {
+  // Run of source pixels that covers one destination pixel
+  struct AreaSpan {
+    uint32_t first, count;
+    uint32_t weightOffset;
+  };
+
+  struct AreaAxis {
+    std::vector<AreaSpan> spans;
+    std::vector<float> weights;
+  };
+
+  struct LevelTarget {
+    uint32_t width, height;
+    AreaAxis horizontal;
+    // Horizontally filtered source rows (width * source height RGBA floats)
+    std::vector<float> rows;
+  };
+
+  AreaAxis buildAreaAxis(uint32_t srcSize, uint32_t dstSize) {
+    AreaAxis axis;
+    axis.spans.reserve(dstSize);
+    const double scale = (double)srcSize / (double)dstSize;
+    for(uint32_t d = 0; d < dstSize; d++) {
+      double start = d * scale;
+      double end = std::min((d + 1) * scale, (double)srcSize);
+      uint32_t first = (uint32_t)start;
+      uint32_t last = std::min((uint32_t)std::ceil(end), srcSize);
+
+      AreaSpan span = {first, last - first, (uint32_t)axis.weights.size()};
+      for(uint32_t i = first; i < last; i++) {
+        double overlap = std::min((double)(i + 1), end) - std::max((double)i, start);
+        axis.weights.emplace_back((float)(overlap / (end - start)));
+      }
+      axis.spans.emplace_back(span);
+    }
+    return axis;
+  }
+
+  // Every pixel is processed as 4 float lanes, regardless of the channel count
+#ifdef LYSSA_IMAGE_SCALER_SSE2
+  typedef __m128 Pixel;
+
+  inline Pixel pxZero() { return _mm_setzero_ps(); }
+  inline Pixel pxLoad(const float* p) { return _mm_loadu_ps(p); }
+  inline void pxStore(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+  inline Pixel pxMulAdd(Pixel acc, Pixel v, float w) {
+    return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w)));
+  }
+  inline uint32_t pxPack(Pixel v) {
+    // Saturating packs clamp to [0, 255]
+    __m128i i32 = _mm_cvtps_epi32(v);
+    __m128i i16 = _mm_packs_epi32(i32, i32);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+  }
+#else
+  struct Pixel { float c[4]; };
+
+  inline Pixel pxZero() { return (Pixel){{0.0f, 0.0f, 0.0f, 0.0f}}; }
+  inline Pixel pxLoad(const float* p) { return (Pixel){{p[0], p[1], p[2], p[3]}}; }
+  inline void pxStore(float* p, Pixel v) { memcpy(p, v.c, sizeof(v.c)); }
+  inline Pixel pxMulAdd(Pixel acc, Pixel v, float w) {
+    for(uint32_t i = 0; i < 4; i++) acc.c[i] += v.c[i] * w;
+    return acc;
+  }
+  inline uint32_t pxPack(Pixel v) {
+    uint32_t ret = 0;
+    for(uint32_t i = 0; i < 4; i++) {
+      long c = lrintf(v.c[i]);
+      c = c < 0 ? 0 : (c > 255 ? 255 : c);
+      ret |= (uint32_t)c << (i * 8);
+    }
+    return ret;
+  }
+#endif
+
+  void expandRow(const unsigned char* src, uint32_t width, int32_t channels, float* dst) {
+    for(uint32_t x = 0; x < width; x++) {
+      for(int32_t c = 0; c < 4; c++) {
+        dst[x * 4 + c] = (c < channels) ? (float)src[x * channels + c] : 0.0f;
+      }
+    }
+  }
+
+  void storeRow(const float* src, uint32_t width, int32_t channels, unsigned char* dst) {
+    for(uint32_t x = 0; x < width; x++) {
+      uint32_t packed = pxPack(pxLoad(src + x * 4));
+      // Little endian: lane 0 is the lowest byte
+      memcpy(dst + x * channels, &packed, channels);
+    }
+  }
+
+  void filterRowHorizontal(const float* srcRow, const AreaAxis& axis, float* dstRow) {
+    for(size_t x = 0; x < axis.spans.size(); x++) {
+      const AreaSpan& span = axis.spans[x];
+      const float* weights = &axis.weights[span.weightOffset];
+      const float* px = srcRow + (size_t)span.first * 4;
+      Pixel acc = pxZero();
+      for(uint32_t i = 0; i < span.count; i++) {
+        acc = pxMulAdd(acc, pxLoad(px + i * 4), weights[i]);
+      }
+      pxStore(dstRow + x * 4, acc);
+    }
+  }
+
+  TextureData filterVertical(const LevelTarget& target, uint32_t srcHeight, int32_t channels) {
+    TextureData ret{};
+    ret.width = target.width;
+    ret.height = target.height;
+    ret.channels = channels;
+    ret.data = (unsigned char*)malloc((size_t)target.width * target.height * channels);
+
+    AreaAxis vertical = buildAreaAxis(srcHeight, target.height);
+    std::vector<float> acc((size_t)target.width * 4);
+    const size_t rowStride = (size_t)target.width * 4;
+
+    for(uint32_t y = 0; y < target.height; y++) {
+      const AreaSpan& span = vertical.spans[y];
+      std::fill(acc.begin(), acc.end(), 0.0f);
+      for(uint32_t i = 0; i < span.count; i++) {
+        const float* row = &target.rows[(span.first + i) * rowStride];
+        const float weight = vertical.weights[span.weightOffset + i];
+        for(uint32_t x = 0; x < target.width; x++) {
+          pxStore(&acc[x * 4], pxMulAdd(pxLoad(&acc[x * 4]), pxLoad(row + x * 4), weight));
+        }
+      }
+      storeRow(acc.data(), target.width, channels, ret.data + (size_t)y * target.width * channels);
+    }
+    return ret;
+  }
+
+  // Reads the source exactly once and feeds every row into all targets
+  void downscaleInto(const TextureData& src, LevelTarget* targets, uint32_t targetCount) {
+    for(uint32_t t = 0; t < targetCount; t++) {
+      targets[t].horizontal = buildAreaAxis(src.width, targets[t].width);
+      targets[t].rows.resize((size_t)targets[t].width * src.height * 4);
+    }
+    std::vector<float> srcRow((size_t)src.width * 4);
+    for(uint32_t y = 0; y < src.height; y++) {
+      expandRow(src.data + (size_t)y * src.width * src.channels, src.width, src.channels, srcRow.data());
+      for(uint32_t t = 0; t < targetCount; t++) {
+        filterRowHorizontal(srcRow.data(), targets[t].horizontal,
+            &targets[t].rows[(size_t)y * targets[t].width * 4]);
+      }
+    }
+  }
+
+  void fitSize(uint32_t srcW, uint32_t srcH, uint32_t boxW, uint32_t boxH, uint32_t* w, uint32_t* h) {
+    float scale = std::min((float)boxW / (float)srcW, (float)boxH / (float)srcH);
+    if(scale >= 1.0f) {
+      *w = srcW;
+      *h = srcH;
+      return;
+    }
+    *w = std::max(1u, (uint32_t)lroundf(srcW * scale));
+    *h = std::max(1u, (uint32_t)lroundf(srcH * scale));
+  }
+
+  TextureData copyTextureData(const TextureData& src) {
+    TextureData ret = src;
+    size_t size = (size_t)src.width * src.height * src.channels;
+    ret.data = (unsigned char*)malloc(size);
+    memcpy(ret.data, src.data, size);
+    return ret;
+  }
+}
+
+namespace ImageScaler {
+  ThumbnailPyramid buildThumbnailPyramid(const void* encodedData, size_t encodedSize, uint32_t levelMask) {
+    ThumbnailPyramid pyramid{};
+
+    TextureData src{};
+    src.data = lf_load_texture_data_from_memory(encodedData, encodedSize,
+        (int32_t*)&src.width, (int32_t*)&src.height, &src.channels, true);
+    if(!src.data || src.width == 0 || src.height == 0 || src.channels < 1 || src.channels > 4) {
+      LOG_ERROR("Failed to decode thumbnail image.");
+      if(src.data) free(src.data);
+      return pyramid;
+    }
+
+    LevelTarget targets[(uint32_t)ThumbnailLevel::LevelCount];
+    uint32_t targetLevels[(uint32_t)ThumbnailLevel::LevelCount];
+    uint32_t targetCount = 0;
+
+    for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::Full; i++) {
+      if(!(levelMask & THUMBNAIL_LEVEL_BIT(i))) continue;
+      uint32_t size = thumbnailLevelSize((ThumbnailLevel)i);
+      uint32_t w, h;
+      fitSize(src.width, src.height, size, size, &w, &h);
+      if(w == src.width && h == src.height) {
+        pyramid.levels[i] = copyTextureData(src);
+        continue;
+      }
+      targets[targetCount].width = w;
+      targets[targetCount].height = h;
+      targetLevels[targetCount++] = i;
+    }
+
+    downscaleInto(src, targets, targetCount);
+    for(uint32_t t = 0; t < targetCount; t++) {
+      pyramid.levels[targetLevels[t]] = filterVertical(targets[t], src.height, src.channels);
+    }
+
+    if(levelMask & THUMBNAIL_LEVEL_BIT(ThumbnailLevel::Full)) {
+      pyramid.levels[(uint32_t)ThumbnailLevel::Full] = src;
+    } else {
+      free(src.data);
+    }
+    return pyramid;
+  }
+
+  TextureData areaDownscale(const TextureData& src, uint32_t width, uint32_t height) {
+    if(width >= src.width && height >= src.height) {
+      return copyTextureData(src);
+    }
+    LevelTarget target{};
+    target.width = std::min(width, src.width);
+    target.height = std::min(height, src.height);
+    downscaleInto(src, &target, 1);
+    TextureData ret = filterVertical(target, src.height, src.channels);
+    ret.path = src.path;
+    return ret;
+  }
+
+  TextureData areaDownscaleToFit(const TextureData& src, uint32_t boxW, uint32_t boxH) {
+    uint32_t w, h;
+    fitSize(src.width, src.height, boxW, boxH, &w, &h);
+    return areaDownscale(src, w, h);
+  }
+
+  ThumbnailPlaceholder buildPlaceholder(const TextureData& src) {
+    ThumbnailPlaceholder placeholder{};
+    if(!src.data || src.width < THUMBNAIL_PLACEHOLDER_SIZE || src.height < THUMBNAIL_PLACEHOLDER_SIZE) {
+      return placeholder;
+    }
+    // The cells fill a square container, so the aspect ratio is not kept here
+    TextureData grid = areaDownscale(src, THUMBNAIL_PLACEHOLDER_SIZE, THUMBNAIL_PLACEHOLDER_SIZE);
+    for(uint32_t i = 0; i < THUMBNAIL_PLACEHOLDER_SIZE * THUMBNAIL_PLACEHOLDER_SIZE; i++) {
+      const unsigned char* px = grid.data + i * grid.channels;
+      for(int32_t c = 0; c < 3; c++) {
+        // Grayscale covers only have the first channel
+        placeholder.colors[i][c] = grid.channels >= 3 ? px[c] : px[0];
+      }
+    }
+    free(grid.data);
+    placeholder.valid = true;
+    return placeholder;
+  }
+
+  uint32_t thumbnailLevelSize(ThumbnailLevel level) {
+    switch(level) {
+      case ThumbnailLevel::Row:
+        return THUMBNAIL_ROW_SIZE;
+      case ThumbnailLevel::Grid:
+        return THUMBNAIL_GRID_SIZE;
+      case ThumbnailLevel::Card:
+        return THUMBNAIL_CARD_SIZE;
+      default:
+        return 0;
+    }
+  }
+
+  ThumbnailLevel nearestThumbnailLevel(float size) {
+    for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::Full; i++) {
+      if(size <= thumbnailLevelSize((ThumbnailLevel)i)) {
+        return (ThumbnailLevel)i;
+      }
+    }
+    return ThumbnailLevel::Full;
+  }
+
+  LfTexture createTexture(const TextureData& data) {
+    LfTexture tex = {0};
+    if(!data.data) return tex;
+    lf_create_texture_from_image_data(LF_TEX_FILTER_LINEAR, &tex.id, data.width, data.height, data.channels, data.data);
+    tex.width = data.width;
+    tex.height = data.height;
+    return tex;
+  }
+
+  void freeThumbnailPyramid(ThumbnailPyramid& pyramid) {
+    for(auto& level : pyramid.levels) {
+      if(level.data) {
+        free(level.data);
+        level.data = NULL;
+      }
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "config.hpp"
+#include "textureData.hpp"
+
+extern "C" {
+#include <leif/leif.h>
+}
+
+#include <filesystem>
+#include <stddef.h>
+#include <stdint.h>
+
+// The sizes a cover is needed at throughout the UI. Every view picks the
+// nearest level instead of stretching whatever texture it happens to have.
+enum class ThumbnailLevel {
+  Row = 0,  // Rows of a playlist (PLAYLIST_FILE_THUMBNAIL_SIZE)
+  Grid,     // Result grid of the playlist search
+  Card,     // Playlist cards on the homepage
+  Full,     // Original resolution (OnTrack, fullscreen)
+  LevelCount
+};
+
+#define THUMBNAIL_LEVEL_BIT(level) (1u << (uint32_t)(level))
+
+// Average colors of a cover on a tiny grid. Drawn as plain rects, so it
+// needs neither a decode nor a texture upload.
+struct ThumbnailPlaceholder {
+  uint8_t colors[THUMBNAIL_PLACEHOLDER_SIZE * THUMBNAIL_PLACEHOLDER_SIZE][3];
+  bool valid;
+};
+
+struct ThumbnailPyramid {
+  // Levels that were not requested have data == NULL
+  TextureData levels[(uint32_t)ThumbnailLevel::LevelCount];
+  std::filesystem::path path;
+  // Hash of the encoded picture (see ThumbnailCache)
+  uint64_t hash;
+  ThumbnailPlaceholder placeholder;
+
+  const TextureData& level(ThumbnailLevel lvl) const {
+    return levels[(uint32_t)lvl];
+  }
+};
+
+namespace ImageScaler {
+  // Decodes the image once and produces every level in levelMask from that
+  // single decode. Levels keep the aspect ratio of the image and are never
+  // upscaled.
+  ThumbnailPyramid buildThumbnailPyramid(const void* encodedData, size_t encodedSize, uint32_t levelMask);
+
+  // Box/area filtered downscale to exactly width x height. The returned data
+  // is malloc'd and owned by the caller.
+  TextureData areaDownscale(const TextureData& src, uint32_t width, uint32_t height);
+
+  // Downscales src to fit into a boxW x boxH box, keeping the aspect ratio.
+  TextureData areaDownscaleToFit(const TextureData& src, uint32_t boxW, uint32_t boxH);
+
+  ThumbnailPlaceholder buildPlaceholder(const TextureData& src);
+
+  uint32_t thumbnailLevelSize(ThumbnailLevel level);
+  ThumbnailLevel nearestThumbnailLevel(float size);
+
+  // Uploads the pixels as a texture, returns an empty texture for empty data
+  LfTexture createTexture(const TextureData& data);
+
+  void freeThumbnailPyramid(ThumbnailPyramid& pyramid);
+}
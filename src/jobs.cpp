@@ -0,0 +1,35 @@
+#include "jobs.hpp"
+
+#include <vector>
+
+struct Job {
+  std::future<void> future;
+  std::function<void()> done;
+};
+
+// UI thread only
+static std::vector<Job> jobs;
+
+namespace Jobs {
+  void add(std::future<void> job, std::function<void()> done) {
+    jobs.push_back({std::move(job), std::move(done)});
+  }
+
+  void poll() {
+    // Completions may add jobs, so the finished ones are taken out first
+    std::vector<Job> finished;
+    for(size_t i = 0; i < jobs.size();) {
+      if(jobs[i].future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        i++;
+        continue;
+      }
+      finished.emplace_back(std::move(jobs[i]));
+      jobs[i] = std::move(jobs.back());
+      jobs.pop_back();
+    }
+    for(auto& job : finished) {
+      job.future.get();
+      job.done();
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "threadPool.hpp"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdint.h>
+
+// Blocking calls of the UI (subprocesses, directory walks, file reads) run
+// as jobs on the ThreadPool. The UI thread picks up finished jobs in poll and
+// runs their completion there, so the frame loop never waits on a syscall.
+namespace Jobs {
+  // done runs on the UI thread from poll once job finished
+  void add(std::future<void> job, std::function<void()> done);
+
+  template<typename T>
+  void submit(std::function<T()> work, std::function<void(T&)> done) {
+    auto result = std::make_shared<T>();
+    add(ThreadPool::submit([work = std::move(work), result]() { *result = work(); }), 
+        [done = std::move(done), result]() { done(*result); });
+  }
+
+  // Called by the UI thread every frame
+  void poll();
+}
+
+// Last result of a query that is repeated on the ThreadPool. get never
+// blocks, it returns the initial value until the first query finished. Has
+// to outlive its queries, so instances are static.
+template<typename T>
+class PolledValue {
+  public:
+    explicit PolledValue(T initial) : _initial(initial), _value(initial) {}
+
+    // Starts the query if none is running and the last one finished at
+    // least interval seconds ago
+    const T& get(float interval, std::function<T()> query) {
+      auto now = std::chrono::steady_clock::now();
+      if(!_running && now - _lastQuery >= std::chrono::duration<float>(interval)) {
+        _running = true;
+        uint64_t generation = _generation;
+        Jobs::submit<T>(std::move(query), [this, generation](T& result) {
+            if(generation != _generation) return;
+            _running = false;
+            _lastQuery = std::chrono::steady_clock::now();
+            _value = result;
+            });
+      }
+      return _value;
+    }
+
+    // Drops the last result and the running query, called when the queried
+    // state was just changed by the UI
+    void reset() {
+      _value = _initial;
+      _generation++;
+      _running = false;
+      _lastQuery = {};
+    }
+
+  private:
+    T _initial, _value;
+    uint64_t _generation = 0;
+    bool _running = false;
+    std::chrono::steady_clock::time_point _lastQuery{};
+};
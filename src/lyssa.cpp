@@ -8,6 +8,14 @@
 #include "utils.hpp"
 #include "global.hpp"
 #include "random.hpp"
+#include "thumbnailCache.hpp"
+#include "duplicateFinder.hpp"
+#include "mediaStore.hpp"
+#include "playlistFile.hpp"
+#include "playlistMembership.hpp"
+#include "threadPool.hpp"
+#include "trackLoader.hpp"
+#include "jobs.hpp"
 
 #include <cglm/types-struct.h>
 #include <cstddef>
@@ -19,8 +27,11 @@
 #include <filesystem>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 extern "C" {
@@ -107,8 +118,6 @@ static void                     updateFullscreenTrackTab();
 static void                     backButtonTo(GuiTab tab, const std::function<void()>& clickCb = nullptr);
 
 static void                     loadPlaylists();
-static void                     loadPlaylistFileAsync(std::vector<SoundFile>* files, std::string path);
-static void                     addFileToPlaylistAsync(std::vector<SoundFile>* files, std::string path, uint32_t playlistIndex);
 
 static void                     moveFileInPlaylistIdx(uint32_t playlistIndex, uint32_t fromIndex, uint32_t toIndex);
 
@@ -127,16 +136,20 @@ static std::string              removeFileExtensionW(const std::string& filename
 static void                     terminateAudio();
 
 static void                     loadIcons();
+static void                     loadTrackThumbnail(const std::filesystem::path& path);
+static LfTexture                getTrackThumbnail();
 
 static void                     handleAsyncPlaylistLoading();
 static void                     loadPlaylistAsync(Playlist& playlist);
+static void                     warmPlaylists();
+static void                     saveLastPlaylist(const std::filesystem::path& playlistPath);
 
-static LfClickableItemState     renderSoundFileThumbnail(vec2s thumbnailContainerSize, SoundFile& file, 
+static LfClickableItemState     renderSoundFileThumbnail(vec2s thumbnailContainerSize, TrackId id, 
                                                           const std::function<void()>& clickCb = nullptr, bool uiResponse = true, float cornerRadius = -1.0f);
 
 static bool                     renderMenuBarElement(const std::string& text, uint32_t iconId);
 
-static std::vector<SoundFile>   matchSoundFiles(const std::vector<SoundFile>& files, const std::string& searchTerm);
+static std::vector<TrackId>     matchSoundFiles(const std::vector<TrackId>& tracks, const std::string& searchTerm);
 static void                     searchPlaylistInputInsertCb(void* inputData);
 static void                     searchPlaylistInputKeyCb(void* inputData);
 
@@ -144,13 +157,53 @@ static LfTextProps              renderTextRaw(vec2s pos, const std::string& text
 
 std::vector<std::filesystem::directory_entry> loadFolderContents(const std::string& folderpath) {
   std::vector<std::filesystem::directory_entry> contents;
-  for (const auto& entry : std::filesystem::directory_iterator(folderpath)) {
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(folderpath, ec)) {
     contents.emplace_back(entry);
   }
   std::sort(contents.begin(), contents.end());
   return contents;
 }
 
+// Lists the folder as a job, a listing that finishes after a newer one for
+// the same contents is dropped
+static void loadFolderContentsAsync(std::vector<std::filesystem::directory_entry>& contents, const std::string& folderpath) {
+  static std::unordered_map<const void*, uint64_t> generations;
+  uint64_t generation = ++generations[&contents];
+  contents.clear();
+  Jobs::submit<std::vector<std::filesystem::directory_entry>>([folderpath]() { return loadFolderContents(folderpath); }, 
+      [&contents, generation](std::vector<std::filesystem::directory_entry>& result) {
+      if(generations[&contents] == generation) contents = std::move(result);
+      });
+}
+
+static std::vector<std::filesystem::path> listDownloadedTracks(const std::string& folderpath) {
+  std::vector<std::filesystem::path> paths;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(folderpath, ec)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".mp3") {
+      paths.emplace_back(entry.path());
+    }
+  }
+  return paths;
+}
+
+// pgrep forks a shell and archive.txt grows with the download, both are
+// checked as jobs instead of every frame
+static PolledValue<bool> ytdlpRunningPoll(true);
+static PolledValue<uint32_t> downloadedFileCountPoll(0);
+// The downloaded tracks are moved into the media store and added to their playlist
+static bool importingDownload = false;
+
+static bool isYtdlpRunning() {
+  return ytdlpRunningPoll.get(PROCESS_POLL_INTERVAL, []() { return LyssaUtils::getCommandOutput("pgrep yt-dlp") != ""; });
+}
+
+static uint32_t getDownloadedFileCount() {
+  std::string archivePath = LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName + "/archive.txt";
+  return downloadedFileCountPoll.get(PROCESS_POLL_INTERVAL, [archivePath]() { return LyssaUtils::getLineCountFile(archivePath); });
+}
+
 void winResizeCb(GLFWwindow* window, int32_t width, int32_t height) {
   lf_resize_display(width, height);
   glViewport(0, 0, width, height);
@@ -248,31 +301,16 @@ void handleTabKeyStrokes() {
   if(lf_key_went_down(GLFW_KEY_G)) {
     Playlist& favourites = state.playlists[0]; // 0th playlist is favourites
     Playlist& currentPlaylist = state.playlists[state.currentPlaylist]; 
-    std::filesystem::path selectedPath = currentPlaylist.musicFiles[currentPlaylist.playingFile].path;
-    if(!Playlist::metadataContainsFile(selectedPath.string(), 0)) {
+    std::filesystem::path selectedPath = currentPlaylist.file(currentPlaylist.playingFile).path();
+    if(!Playlist::containsFile(selectedPath, 0)) {
       if(favourites.loaded) {
         Playlist::addFile(selectedPath, 0);
-        favourites.loaded = false;
       } else {
-        std::ofstream metadata(favourites.path.string() + "/.metadata", std::ios::app);
-        metadata.seekp(0, std::ios::end);
-
-        metadata << "\"" << selectedPath.string() << "\" ";
-        metadata.close();
+        Playlist::appendFiles({selectedPath.string()}, 0);
       }
       state.infoCards.addCard("Added to favourites.");
     } else {
-      if(!favourites.loaded) {
-        std::vector<std::string> paths = PlaylistMetadata::getFilepaths(
-            std::filesystem::directory_entry(state.playlists[0].path));
-        for(auto& path : paths) {
-          favourites.musicFiles.push_back((SoundFile){.path = path});
-        }
-        Playlist::removeFile(selectedPath.string(), 0);
-        favourites.musicFiles.clear();
-      } else {
-        Playlist::removeFile(selectedPath.string(), 0);
-      }
+      Playlist::removeFile(selectedPath.string(), 0);
       state.infoCards.addCard("Removed from favourites.");
     }
   }
@@ -295,11 +333,8 @@ if(lf_key_event().pressed && lf_key_event().happened) {
           } else {
             Playlist& currentPlaylist = state.playlists[state.currentPlaylist];
             if(currentPlaylist.playingFile == -1) return;
-            state.currentSoundFile = &currentPlaylist.musicFiles[currentPlaylist.playingFile];
-            if(state.onTrackTab.trackThumbnail.width != 0) {
-              lf_free_texture(&state.onTrackTab.trackThumbnail);
-            }
-            state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path, (vec2s){-1, -1});
+            state.currentTrack = currentPlaylist.tracks[currentPlaylist.playingFile];
+            loadTrackThumbnail(TrackTable::get(state.currentTrack).path());
             changeTabTo(GuiTab::OnTrack);
           }
           break;
@@ -338,8 +373,8 @@ if(lf_key_event().pressed && lf_key_event().happened) {
         {
           Playlist& currentPlaylist = state.playlists[state.currentPlaylist];
           playlistPlayFileWithIndex(currentPlaylist.selectedFile, state.currentPlaylist);
-          state.currentSoundFile = &currentPlaylist.musicFiles[currentPlaylist.playingFile];
-          float filePosY = currentPlaylist.musicFiles[currentPlaylist.playingFile].renderPosY;
+          state.currentTrack = currentPlaylist.tracks[currentPlaylist.playingFile];
+          float filePosY = currentPlaylist.rowPosY(currentPlaylist.playingFile);
           currentPlaylist.scroll = -filePosY;
           break;
         }
@@ -365,12 +400,12 @@ if(lf_key_event().pressed && lf_key_event().happened) {
         if(state.currentTab == GuiTab::OnPlaylist)
         {
           Playlist& currentPlaylist = state.playlists[state.currentPlaylist];
-          if(currentPlaylist.selectedFile + 1 < currentPlaylist.musicFiles.size()) {
+          if(currentPlaylist.selectedFile + 1 < currentPlaylist.tracks.size()) {
             currentPlaylist.selectedFile++;
           } else {
             currentPlaylist.selectedFile = 0;
           }
-          float filePosY = currentPlaylist.musicFiles[currentPlaylist.selectedFile].renderPosY;
+          float filePosY = currentPlaylist.rowPosY(currentPlaylist.selectedFile);
           currentPlaylist.scroll = -filePosY;
         }
         break;
@@ -381,9 +416,9 @@ if(lf_key_event().pressed && lf_key_event().happened) {
           if(currentPlaylist.selectedFile - 1 >= 0) {
             currentPlaylist.selectedFile--;
           } else {
-            currentPlaylist.selectedFile = currentPlaylist.musicFiles.size() - 1;
+            currentPlaylist.selectedFile = currentPlaylist.tracks.size() - 1;
           }
-          float filePosY = currentPlaylist.musicFiles[currentPlaylist.selectedFile].renderPosY;
+          float filePosY = currentPlaylist.rowPosY(currentPlaylist.selectedFile);
           currentPlaylist.scroll = -filePosY;
         }
         break;
@@ -461,7 +496,7 @@ static void renderHomepage() {
             [&](){
             if(state.playlistAddFromFolderTab.currentFolderPath.empty()) {
             state.playlistAddFromFolderTab.currentFolderPath = std::string(getenv(HOMEDIR));
-            state.playlistAddFromFolderTab.folderContents = loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+            loadFolderContentsAsync(state.playlistAddFromFolderTab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
             }
             changeTabTo(GuiTab::CreatePlaylistFromFolder);
             state.popups[PopupType::TwoChoicePopup]->shouldRender = false;
@@ -511,7 +546,7 @@ static void renderHomepage() {
             [&](){
             if(state.playlistAddFromFolderTab.currentFolderPath.empty()) {
             state.playlistAddFromFolderTab.currentFolderPath = std::string(getenv(HOMEDIR));
-            state.playlistAddFromFolderTab.folderContents = loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+            loadFolderContentsAsync(state.playlistAddFromFolderTab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
             }
             changeTabTo(GuiTab::CreatePlaylistFromFolder);
             state.popups[PopupType::TwoChoicePopup]->shouldRender = false;
@@ -646,7 +681,7 @@ static void renderHomepage() {
           if(state.soundHandler.isInit) {
             state.soundHandler.stop();
             state.soundHandler.uninit();
-            state.currentSoundFile = nullptr;
+            state.currentTrack = TRACK_ID_NONE;
           }
           Playlist::remove(i);
           state.infoCards.addCard("Removed playlist.");
@@ -665,10 +700,6 @@ static void renderHomepage() {
       if(onContainer && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT) && !onActionButton) { 
         state.currentPlaylist = i;
         if(!playlist.loaded) {
-          state.loadedPlaylistFilepaths.clear();
-          state.loadedPlaylistFilepaths.shrink_to_fit();
-
-          state.loadedPlaylistFilepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(playlist.path));
           loadPlaylistAsync(playlist);
           playlist.loaded = true;
         }
@@ -779,10 +810,6 @@ void renderDashboardNav() {
             state.currentPlaylist = 0; // 0 is allocated for favourites
             Playlist& favourites = state.playlists[state.currentPlaylist];
             if(!favourites.loaded) {
-              state.loadedPlaylistFilepaths.clear();
-              state.loadedPlaylistFilepaths.shrink_to_fit();
-
-              state.loadedPlaylistFilepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(favourites.path));
               loadPlaylistAsync(favourites);
               favourites.loaded = true;
             }
@@ -976,8 +1003,7 @@ void renderCreatePlaylistFromFolder() {
         if(entry.is_directory()) {
         PlaylistAddFromFolderTab& tab = state.playlistAddFromFolderTab;
         tab.currentFolderPath = entry.path().string();
-        tab.folderContents.clear();
-        tab.folderContents = loadFolderContents(tab.currentFolderPath);
+        loadFolderContentsAsync(tab.folderContents, tab.currentFolderPath);
         lf_set_current_div_scroll(0.0f);
         lf_set_current_div_scroll_velocity(0.0f);
         }
@@ -985,8 +1011,7 @@ void renderCreatePlaylistFromFolder() {
         [&](){
         PlaylistAddFromFolderTab& tab = state.playlistAddFromFolderTab;
         tab.currentFolderPath = std::filesystem::path(tab.currentFolderPath).parent_path().string();
-        tab.folderContents.clear();
-        tab.folderContents = loadFolderContents(tab.currentFolderPath); 
+        loadFolderContentsAsync(tab.folderContents, tab.currentFolderPath);
         },
         nullptr,
         [&](std::filesystem::directory_entry entry, bool hovered){
@@ -1035,16 +1060,21 @@ void renderCreatePlaylistFromFolder() {
   } else {
     renderCreatePlaylist([&](){
         loadPlaylists();
-        PlaylistAddFromFolderTab& tab = state.playlistAddFromFolderTab;
-        uint32_t playlist = state.playlists.size() - 1;
-        std::ofstream metadata(state.playlists[playlist].path.string() + "/.metadata", std::ios::app);
-        metadata.seekp(0, std::ios::end);
-        for(const auto& entry : std::filesystem::directory_iterator(tab.currentFolderPath)) {
-        if(!entry.is_directory() && SoundTagParser::isValidSoundFile(entry.path().string())) {
-        metadata << "\"" << entry.path().string() << "\" ";
-        }
-        }
-        metadata.close();
+        std::string folderPath = state.playlistAddFromFolderTab.currentFolderPath;
+        PlaylistHandle playlist = state.playlists.back().handle;
+        Jobs::submit<std::vector<std::filesystem::path>>([folderPath]() {
+            std::vector<std::filesystem::path> paths;
+            for(const auto& entry : loadFolderContents(folderPath)) {
+              if(!entry.is_directory()) {
+                paths.emplace_back(entry.path());
+              }
+            }
+            return paths;
+            }, 
+            [playlist](std::vector<std::filesystem::path>& paths) {
+            int32_t playlistIndex = Playlist::indexOf(playlist);
+            if(playlistIndex != -1) Playlist::addFiles(paths, playlistIndex);
+            });
         }, 
         [&](){
         LfUIElementProps props = call_to_action_button_style();
@@ -1075,9 +1105,11 @@ static std::string removeSpecialCharactersStr(const std::string& input) {
 
 void renderDownloadPlaylist() {
   std::string downloadedPlaylistDir = LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName; 
-  uint32_t downloadedFileCount = LyssaUtils::getLineCountFile(downloadedPlaylistDir + "/archive.txt");
+  uint32_t downloadedFileCount = getDownloadedFileCount();
 
   static std::string url;
+  // yt-dlp resolves the name of the playlist over the network
+  static bool resolvingUrl = false;
 
   if(state.playlistDownloadFinished) {
     // Heading
@@ -1108,7 +1140,7 @@ void renderDownloadPlaylist() {
 
     {
       lf_next_line();
-      if(LyssaUtils::getCommandOutput("pgrep yt-dlp") == "") {
+      if(!isYtdlpRunning() && !importingDownload) {
         LfUIElementProps props = call_to_action_button_style();
         props.margin_left = 0;
         props.margin_top = 15;
@@ -1134,10 +1166,6 @@ void renderDownloadPlaylist() {
           state.currentPlaylist = playlistIndex;
           auto& playlist = state.playlists[state.currentPlaylist];
           if(!playlist.loaded) {
-            state.loadedPlaylistFilepaths.clear();
-            state.loadedPlaylistFilepaths.shrink_to_fit();
-
-            state.loadedPlaylistFilepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(playlist.path));
             loadPlaylistAsync(playlist);
             playlist.loaded = true;
           }
@@ -1200,28 +1228,38 @@ void renderDownloadPlaylist() {
 
     {
       lf_push_style_props(call_to_action_button_style());
-      if(lf_button_fixed("Download", 150, -1) == LF_CLICKED) {
-        state.downloadingPlaylistName = LyssaUtils::getCommandOutput(
-            std::string("yt-dlp \"" + std::string(urlInput) + "\" --flat-playlist --dump-single-json --no-warnings | jq -r .title &"));
-        state.downloadingPlaylistName = removeSpecialCharactersStr(state.downloadingPlaylistName); 
-
-        if(state.downloadingPlaylistName != "null") {
-          std::string downloadCmd = LYSSA_DIR + "/scripts/download.sh \"" + urlInput + "\" " + LYSSA_DIR + "/downloaded_playlists/ &"; 
-          system(downloadCmd.c_str());
-          state.playlistDownloadRunning = true;
-          state.downloadPlaylistFileCount = LyssaUtils::getPlaylistFileCountURL(urlInput);
-          url = urlInput;
-          memset(urlInput, 0, INPUT_BUFFER_SIZE);
-        } else {
-          LOG_ERROR("Invalid URL Provided.");
-          memset(urlInput, 0, INPUT_BUFFER_SIZE);
-        }
+      if(lf_button_fixed("Download", 150, -1) == LF_CLICKED && !resolvingUrl) {
+        std::string requestedUrl = urlInput;
+        memset(urlInput, 0, INPUT_BUFFER_SIZE);
+        resolvingUrl = true;
+        Jobs::submit<std::pair<std::string, uint32_t>>([requestedUrl]() {
+            std::string name = removeSpecialCharactersStr(LyssaUtils::getCommandOutput(
+                std::string("yt-dlp \"" + requestedUrl + "\" --flat-playlist --dump-single-json --no-warnings | jq -r .title &")));
+            uint32_t fileCount = name != "null" ? LyssaUtils::getPlaylistFileCountURL(requestedUrl) : 0;
+            return std::make_pair(name, fileCount);
+            }, 
+            [requestedUrl](std::pair<std::string, uint32_t>& result) {
+            resolvingUrl = false;
+            if(result.first == "null") {
+              LOG_ERROR("Invalid URL Provided.");
+              return;
+            }
+            state.downloadingPlaylistName = result.first;
+            std::string downloadCmd = LYSSA_DIR + "/scripts/download.sh \"" + requestedUrl + "\" " + LYSSA_DIR + "/downloaded_playlists/ " + 
+              MediaStore::getStoreDir().string() + " &"; 
+            system(downloadCmd.c_str());
+            ytdlpRunningPoll.reset();
+            downloadedFileCountPoll.reset();
+            state.playlistDownloadRunning = true;
+            state.downloadPlaylistFileCount = result.second;
+            url = requestedUrl;
+            });
       }
       lf_pop_style_props();
     }
   } else  {
     static float ytdlpDownTimer = 0.0f;
-    if(LyssaUtils::getCommandOutput("pgrep yt-dlp") == "") {
+    if(!isYtdlpRunning()) {
       ytdlpDownTimer += state.deltaTime;
       if(ytdlpDownTimer >= 2.0f) {
         ytdlpDownTimer = 0.0f;
@@ -1230,27 +1268,35 @@ void renderDownloadPlaylist() {
     } else {
       ytdlpDownTimer = 0.0f;
     }
-      state.downloadPlaylistFileCount == LyssaUtils::getLineCountFile(LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName + "/archive.txt");
 
     if(state.playlistDownloadFinished) {
-      FileStatus createStatus = Playlist::create(state.downloadingPlaylistName, "Downloaded Playlist", url);
-
-      if(createStatus != FileStatus::AlreadyExists) {
-        std::string playlistDir = LYSSA_DIR + "/playlists/" + state.downloadingPlaylistName; 
-        std::ofstream metadata(playlistDir + "/.metadata", std::ios::app);
-
-        metadata.seekp(0, std::ios::end);
-
-        for (const auto& entry : std::filesystem::directory_iterator(downloadedPlaylistDir)) {
-          if (entry.is_regular_file() && entry.path().extension() == ".mp3") {
-            metadata << "\"" << entry.path().string() << "\" ";
+      std::string name = state.downloadingPlaylistName;
+      std::string playlistUrl = url;
+      importingDownload = true;
+      Jobs::submit<std::vector<std::filesystem::path>>([downloadedPlaylistDir]() {
+          MediaStore::ingestFolder(downloadedPlaylistDir);
+          return listDownloadedTracks(downloadedPlaylistDir);
+          }, 
+          [name, playlistUrl](std::vector<std::filesystem::path>& tracks) {
+          FileStatus createStatus = Playlist::create(name, "Downloaded Playlist", playlistUrl);
+
+          if(createStatus != FileStatus::AlreadyExists) {
+            // Registered first, so the tracks enter the membership index
+            loadPlaylists();
+            Playlist playlist{};
+            playlist.path = LYSSA_DIR + "/playlists/" + name; 
+            auto it = std::find(state.playlists.begin(), state.playlists.end(), playlist);
+            if(it != state.playlists.end()) {
+              std::vector<std::string> paths(tracks.begin(), tracks.end());
+              Playlist::appendFiles(paths, (uint32_t)(it - state.playlists.begin()));
+            }
           }
-        }
-        metadata.close();
-      }
-      std::string downloadThumbnailCmd = "yt-dlp --playlist-items 1 --skip-download --convert-thumbnails jpg --write-thumbnail -o \"" 
-        + LYSSA_DIR + "/playlists/" + state.downloadingPlaylistName + "/thumbnail.jpg\" " + url + " &";
-      system(downloadThumbnailCmd.c_str());
+          std::string downloadThumbnailCmd = "yt-dlp --playlist-items 1 --skip-download --convert-thumbnails jpg --write-thumbnail -o \"" 
+            + LYSSA_DIR + "/playlists/" + name + "/thumbnail.jpg\" " + playlistUrl + " &";
+          system(downloadThumbnailCmd.c_str());
+          ytdlpRunningPoll.reset();
+          importingDownload = false;
+          });
     }
 
     {
@@ -1330,13 +1376,14 @@ void renderDownloadPlaylist() {
       if(lf_button_fixed("Cancle", buttonSize, -1) == LF_CLICKED) {
         state.playlistDownloadRunning = false;
         system("pkill yt-dlp &");
+        ytdlpRunningPoll.reset();
       }
       lf_pop_style_props();
     }
   }
   lf_div_end();
 
-  if(LyssaUtils::getCommandOutput("pgrep yt-dlp") == "") {
+  if(!isYtdlpRunning()) {
     beginBottomNavBar();
     backButtonTo(GuiTab::Dashboard, [&](){
         loadPlaylists();
@@ -1353,9 +1400,9 @@ void renderOnPlaylist() {
 
   if(state.playlistDownloadRunning) {
     if(!clearedPlaylist) {
-      currentPlaylist.musicFiles.clear();
-      state.loadedPlaylistFilepaths.clear();
-      state.playlistFileThumbnailData.clear();
+      currentPlaylist.tracks.clear();
+      PlaylistMembership::clear(currentPlaylist.id);
+      currentPlaylist.loader->filepaths.clear();
       Playlist::save(state.currentPlaylist);
       clearedPlaylist = true;
     }
@@ -1363,7 +1410,7 @@ void renderOnPlaylist() {
 
     static float ytdlpDownTimer = 0.0f;
     bool downloadFinished = false;
-    if(LyssaUtils::getCommandOutput("pgrep yt-dlp") == "") {
+    if(!isYtdlpRunning()) {
       ytdlpDownTimer += state.deltaTime;
       if(ytdlpDownTimer >= 2.0f) {
         ytdlpDownTimer = 0.0f;
@@ -1374,16 +1421,18 @@ void renderOnPlaylist() {
     }
     if(downloadFinished) {
       state.playlistDownloadRunning = false;
-      state.loadedPlaylistFilepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName));
-      for (const auto& entry : std::filesystem::directory_iterator(LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName)) {
-        if (entry.is_regular_file() && 
-            !Playlist::containsFile(entry.path().string(), state.currentPlaylist) && 
-            SoundTagParser::isValidSoundFile(entry.path().string()) && entry.path().extension() == ".mp3") {
-          state.loadedPlaylistFilepaths.emplace_back(entry.path().string());
-          state.playlistFileFutures.emplace_back(std::async(std::launch::async, addFileToPlaylistAsync, 
-                &state.playlists[state.currentPlaylist].musicFiles, entry.path().string(), state.currentPlaylist));
-        }
-      }
+      std::string downloadedPlaylistDir = LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName;
+      PlaylistHandle playlist = currentPlaylist.handle;
+      Jobs::submit<std::vector<std::filesystem::path>>([downloadedPlaylistDir]() {
+          MediaStore::ingestFolder(downloadedPlaylistDir);
+          return listDownloadedTracks(downloadedPlaylistDir);
+          }, 
+          [downloadedPlaylistDir, playlist](std::vector<std::filesystem::path>& paths) {
+          int32_t playlistIndex = Playlist::indexOf(playlist);
+          if(playlistIndex == -1) return;
+          state.playlists[playlistIndex].loader->filepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(downloadedPlaylistDir));
+          Playlist::addFiles(paths, playlistIndex);
+          });
     }
   }
 
@@ -1418,7 +1467,7 @@ void renderOnPlaylist() {
     lf_pop_style_props();
 
     // "Add More" button
-    if(!currentPlaylist.musicFiles.empty())
+    if(!currentPlaylist.tracks.empty())
     {
       lf_push_font(&state.h5Font);
       const char* text = "Add more music";
@@ -1449,7 +1498,7 @@ void renderOnPlaylist() {
             [&](){
             if(state.playlistAddFromFolderTab.currentFolderPath.empty()) {
             state.playlistAddFromFolderTab.currentFolderPath = std::string(getenv(HOMEDIR));
-            state.playlistAddFromFolderTab.folderContents = loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+            loadFolderContentsAsync(state.playlistAddFromFolderTab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
             }
             changeTabTo(GuiTab::PlaylistAddFromFolder);
             state.popups[PopupType::TwoChoicePopup]->shouldRender = false;
@@ -1465,7 +1514,8 @@ void renderOnPlaylist() {
       lf_next_line();
       if(renderMenuBarElement("Sync Downloads", state.icons["sync"].id)) {
         terminateAudio();
-        system(std::string(LYSSA_DIR + "/scripts/download.sh \"" + currentPlaylist.url + "\" " + LYSSA_DIR + "/downloaded_playlists/ &").c_str());
+        system(std::string(LYSSA_DIR + "/scripts/download.sh \"" + currentPlaylist.url + "\" " + LYSSA_DIR + "/downloaded_playlists/ " + 
+              MediaStore::getStoreDir().string() + " &").c_str());
 
         state.playlistDownloadRunning = true;
         state.downloadingPlaylistName = std::filesystem::path(currentPlaylist.path).filename().string();
@@ -1475,21 +1525,31 @@ void renderOnPlaylist() {
       }
       if(renderMenuBarElement("Search", state.icons["search"].id)) {
         state.searchPlaylistResults.clear();
-        state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].musicFiles, "");
+        state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].tracks, "");
         changeTabTo(GuiTab::SearchPlaylist);
       }
       if(renderMenuBarElement("Jump to top", state.icons["jump_to_top"].id)) {
-        float filePosY = currentPlaylist.musicFiles[0].renderPosY;
+        float filePosY = currentPlaylist.rowPosY(0);
         currentPlaylist.scroll = -filePosY;
       }
       if(renderMenuBarElement("Jump to bottom", state.icons["jump_to_bottom"].id)) {
-        float filePosY = currentPlaylist.musicFiles[currentPlaylist.musicFiles.size() - 1].renderPosY;
+        float filePosY = currentPlaylist.rowPosY(currentPlaylist.tracks.size() - 1);
         currentPlaylist.scroll = -filePosY;
       }
       lf_set_ptr_y_absolute(lf_get_ptr_y() + 60.0f);
     }
   }
 
+  // Progress of Playlist::addFiles, the counters are atomic
+  const PlaylistLoadContext& loader = *currentPlaylist.loader;
+  if(loader.addTotal > 0) {
+    std::string text = "Adding files... " + std::to_string(loader.addDone) + "/" + std::to_string(loader.addTotal);
+    lf_push_font(&state.h6Font);
+    lf_text(text.c_str());
+    lf_pop_font();
+    lf_next_line();
+  }
+
   if(state.playlistDownloadRunning) {
     lf_set_ptr_y(100);
     lf_push_font(&state.h5Font);
@@ -1510,7 +1570,7 @@ void renderOnPlaylist() {
     lf_next_line();
     {
         std::string downloadedPlaylistDir = LYSSA_DIR + "/downloaded_playlists/" + state.downloadingPlaylistName; 
-        uint32_t downloadedFileCount = MIN(LyssaUtils::getLineCountFile(downloadedPlaylistDir + "/archive.txt"), state.downloadPlaylistFileCount);
+        uint32_t downloadedFileCount = MIN(getDownloadedFileCount(), state.downloadPlaylistFileCount);
         const vec2s progressBarSize = (vec2s){400, 6};
 
         LfUIElementProps props = lf_get_theme().slider_props;
@@ -1556,7 +1616,7 @@ void renderOnPlaylist() {
             lf_pop_font();
         }
     }
-  } else if(currentPlaylist.musicFiles.empty()) {
+  } else if(currentPlaylist.tracks.empty()) {
       lf_next_line();
     // Text
     if(state.currentPlaylist != 0) // 0th playlist is favourites
@@ -1600,12 +1660,12 @@ void renderOnPlaylist() {
           if(lf_button_fixed("Add from Folder", buttonWidth, 40) == LF_CLICKED) {
               if(state.playlistAddFromFolderTab.currentFolderPath.empty()) {
                   state.playlistAddFromFolderTab.currentFolderPath = std::string(getenv(HOMEDIR));
-                  state.playlistAddFromFolderTab.folderContents =  loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+                  loadFolderContentsAsync(state.playlistAddFromFolderTab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
               }
               if(state.soundHandler.isInit) {
                   state.soundHandler.stop();
                   state.soundHandler.uninit();
-                  state.currentSoundFile = nullptr;
+                  state.currentTrack = TRACK_ID_NONE;
               }
               changeTabTo(GuiTab::PlaylistAddFromFolder);
           }
@@ -1693,8 +1753,37 @@ void renderOnPlaylist() {
     static bool draggingTrack = false;
     static std::string draggingTrackTitle = "";
     static int32_t draggingTrackIndex = -1;
-    for(uint32_t i = 0; i < currentPlaylist.musicFiles.size(); i++) {
-      SoundFile& file = currentPlaylist.musicFiles[i];
+
+    float listPosY = lf_get_ptr_y();
+    currentPlaylist.rowsPosY = (listPosY - currentPlaylist.scroll) - lf_get_current_div().aabb.size.y;
+    // Once the row height is known, rows outside of the div are skipped
+    // without touching the metadata of their tracks
+    uint32_t firstRow = 0, endRow = currentPlaylist.tracks.size();
+    float rowHeight = currentPlaylist.rowHeight;
+    if(rowHeight > 0.0f) {
+      float visibleTop = lf_get_current_div().aabb.pos.y - listPosY;
+      float visibleBottom = visibleTop + lf_get_current_div().aabb.size.y;
+      firstRow = (uint32_t)std::clamp(floorf(visibleTop / rowHeight), 0.0f, (float)endRow);
+      endRow = (uint32_t)std::clamp(ceilf(visibleBottom / rowHeight), (float)firstRow, (float)endRow);
+      lf_set_ptr_y_absolute(listPosY + firstRow * rowHeight);
+    }
+    // The rows on screen are loaded first, then the playing and selected track
+    if(TrackLoader::isLoading()) {
+      static std::vector<TrackId> focus;
+      focus.clear();
+      if(rowHeight > 0.0f) {
+        focus.assign(currentPlaylist.tracks.begin() + firstRow, currentPlaylist.tracks.begin() + endRow);
+      }
+      for(int32_t i : {currentPlaylist.playingFile, currentPlaylist.selectedFile}) {
+        if(i >= 0 && i < (int32_t)currentPlaylist.tracks.size()) {
+          focus.emplace_back(currentPlaylist.tracks[i]);
+        }
+      }
+      TrackLoader::prioritize(focus);
+    }
+    for(uint32_t i = firstRow; i < endRow; i++) {
+      TrackId id = currentPlaylist.tracks[i];
+      SoundFile& file = TrackTable::get(id);
       bool onActionButton = false;
       {
         vec2s thumbnailContainerSize = PLAYLIST_FILE_THUMBNAIL_SIZE;
@@ -1702,8 +1791,6 @@ void renderOnPlaylist() {
 
         float marginBottomThumbnail = 10.0f, marginTopThumbnail = 5.0f;
 
-        file.renderPosY = (lf_get_ptr_y() - currentPlaylist.scroll) - lf_get_current_div().aabb.size.y;
-
         LfAABB fileAABB = (LfAABB){
           .pos = (vec2s){lf_get_ptr_x(), lf_get_ptr_y()},
             .size = (vec2s){(float)state.win->getWidth() - DIV_START_X * 2, (float)thumbnailContainerSize.y + marginBottomThumbnail}
@@ -1714,7 +1801,7 @@ void renderOnPlaylist() {
           currentPlaylist.selectedFile = (int32_t)i;
         }
         if(hoveredTextDiv && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_RIGHT)) {
-          state.popups[PopupType::PlaylistFileDialoguePopup] = std::make_unique<PlaylistFileDialoguePopup>(file.path, 
+          state.popups[PopupType::PlaylistFileDialoguePopup] = std::make_unique<PlaylistFileDialoguePopup>(file.path(), 
                   (vec2s){(float)lf_get_mouse_x() + 10, (float)lf_get_mouse_y() + 10});
           state.popups[PopupType::PlaylistFileDialoguePopup]->shouldRender = true;
         }
@@ -1733,7 +1820,7 @@ void renderOnPlaylist() {
           LfClickableItemState state = lf_image_button(((LfTexture){.id = id, .width = 25, .height = 7}));
 
           if(lf_mouse_button_went_down(GLFW_MOUSE_BUTTON_LEFT) && state != LF_IDLE) {
-            draggingTrackTitle = file.title;
+            draggingTrackTitle = file.title();
             draggingTrackIndex = i;
           } 
           if(!draggingTrack && draggingTrackTitle != "" && (fabsf(lf_get_mouse_x_delta()) > 2 || fabsf(lf_get_mouse_y_delta()) > 2)) {
@@ -1752,7 +1839,7 @@ void renderOnPlaylist() {
             bool hoveredPlayButton = lf_hovered((vec2s){indexPos.x - 5, indexPos.y}, 
                 (vec2s){(float)lf_get_theme().font.font_size, (float)lf_get_theme().font.font_size}); 
             onActionButton = hoveredPlayButton;
-            if(hoveredTextDiv && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT) && onActionButton && state.playlistFileFutures.empty()) {
+            if(hoveredTextDiv && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT) && onActionButton) {
               if(currentPlaylist.playingFile == i) {
                 if(state.soundHandler.isPlaying)
                   state.soundHandler.stop();
@@ -1760,7 +1847,7 @@ void renderOnPlaylist() {
                   state.soundHandler.play();
               } else {
                 playlistPlayFileWithIndex(i, state.currentPlaylist);
-                state.currentSoundFile = &file;
+                state.currentTrack = id;
               }
             }
             lf_image_render((vec2s){indexPos.x - 2.5f, indexPos.y}, LF_WHITE, 
@@ -1776,21 +1863,15 @@ void renderOnPlaylist() {
         // Thumbnail + Title
         {
           lf_set_ptr_y_absolute(lf_get_ptr_y() + marginTopThumbnail);
-          LfClickableItemState thumbnailState = renderSoundFileThumbnail(thumbnailContainerSize, file, nullptr, false);
+          LfClickableItemState thumbnailState = renderSoundFileThumbnail(thumbnailContainerSize, id, nullptr, false);
 
           if(thumbnailState == LF_CLICKED && i != currentPlaylist.playingFile) {
-            state.currentSoundFile = &file;
-            if(state.onTrackTab.trackThumbnail.width != 0) {
-              lf_free_texture(&state.onTrackTab.trackThumbnail);
-            }
-            state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path, (vec2s){-1, -1});
+            state.currentTrack = id;
+            loadTrackThumbnail(file.path());
             changeTabTo(GuiTab::OnTrack);
             playlistPlayFileWithIndex(i, state.currentPlaylist);
           } else if(thumbnailState == LF_CLICKED && i == currentPlaylist.playingFile) {
-            if(state.onTrackTab.trackThumbnail.width != 0) {
-              lf_free_texture(&state.onTrackTab.trackThumbnail);
-            }
-            state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path, (vec2s){-1, -1});
+            loadTrackThumbnail(file.path());
             changeTabTo(GuiTab::OnTrack);
           }
          
@@ -1799,8 +1880,7 @@ void renderOnPlaylist() {
           }
           lf_set_line_height(thumbnailContainerSize.y + marginBottomThumbnail);
 
-          std::filesystem::path fsPath(file.path);
-          std::string filename = file.title == "" ? removeFileExtensionW(fsPath.filename().string()) : file.title;
+          std::string filename = file.title().empty() ? removeFileExtensionW(file.filename()) : file.title();
 
 
           /* Title */
@@ -1810,7 +1890,7 @@ void renderOnPlaylist() {
 
           renderTextRaw((vec2s){lf_get_ptr_x(), lf_get_ptr_y() + marginTopThumbnail}, filename.c_str(), state.h6BoldFont, 
               (currentPlaylist.selectedFile == i ? lf_color_brightness(LF_WHITE, 0.7f) : LF_WHITE), -1);
-          renderTextRaw((vec2s){lf_get_ptr_x(), lf_get_ptr_y() + marginTopThumbnail + state.h6Font.font_size}, file.artist.empty() ? "-" : file.artist.c_str(), state.h5Font,
+          renderTextRaw((vec2s){lf_get_ptr_x(), lf_get_ptr_y() + marginTopThumbnail + state.h6Font.font_size}, file.artist().empty() ? "-" : file.artist().c_str(), state.h5Font,
               lf_color_brightness(GRAY, 1.4f));
 
           lf_unset_cull_end_x();
@@ -1831,7 +1911,7 @@ void renderOnPlaylist() {
             lf_text("-");
           lf_pop_style_props();
           // 0th playlist index is favourites
-          if((Playlist::containsFile(file.path, 0) || Playlist::metadataContainsFile(file.path, 0)) && state.currentPlaylist != 0)
+          if(Playlist::containsTrack(currentPlaylist.tracks[i], 0) && state.currentPlaylist != 0)
           {
               LfUIElementProps props = lf_get_theme().button_props;
               props.border_width = 0.0f;
@@ -1848,16 +1928,12 @@ void renderOnPlaylist() {
           }
         }
 
-        if(lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT) && hoveredTextDiv && !onActionButton && state.playlistFileFutures.empty()) {
+        if(lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT) && hoveredTextDiv && !onActionButton) {
           if(!draggingTrack) {
             playlistPlayFileWithIndex(i, state.currentPlaylist);
-            state.currentSoundFile = &file;
+            state.currentTrack = id;
           } else {
-            if(state.currentSoundFile) {
-              if(*state.currentSoundFile == currentPlaylist.musicFiles[draggingTrackIndex]) {
-                terminateAudio();
-              }
-            }
+            // The playing row is moved along, playback continues
             moveFileInPlaylistIdx(state.currentPlaylist, draggingTrackIndex, i);
             draggingTrack = false;
             draggingTrackTitle = "";
@@ -1873,7 +1949,7 @@ void renderOnPlaylist() {
           lf_push_style_props(props);
           LfClickableItemState durationState = lf_button(durationText.c_str());
           if(lf_mouse_button_went_down(GLFW_MOUSE_BUTTON_LEFT) && durationState != LF_IDLE) {
-            draggingTrackTitle = file.title;
+            draggingTrackTitle = file.title();
             draggingTrackIndex = i;
           } 
           if(!draggingTrack && draggingTrackTitle != "" && (fabsf(lf_get_mouse_x_delta()) > 2 || fabsf(lf_get_mouse_y_delta()) > 2)) {
@@ -1889,8 +1965,13 @@ void renderOnPlaylist() {
           draggingTrackTitle = "";
         }
         lf_next_line(); 
+        currentPlaylist.rowHeight = lf_get_ptr_y() - startPtr.y;
       }
     }
+    if(rowHeight > 0.0f) {
+      // The skipped rows still count for the scrollable area
+      lf_set_ptr_y_absolute(listPosY + currentPlaylist.tracks.size() * rowHeight);
+    }
     lf_div_end();
     if(draggingTrack) {
       LfUIElementProps props = lf_get_theme().div_props;
@@ -1907,7 +1988,7 @@ void renderOnPlaylist() {
     }
   }
 
-  if(state.playlistFileFutures.empty()) {
+  {
     beginBottomNavBar();
     backButtonTo(GuiTab::Dashboard, [&](){
         if(state.dashboardTab == DashboardTab::Favourites) {
@@ -1920,8 +2001,8 @@ void renderOnPlaylist() {
   }
 }
 void renderOnTrack() {
-  if(!state.currentSoundFile) return;
-  SoundFile* soundFile = state.currentSoundFile;
+  if(state.currentTrack == TRACK_ID_NONE) return;
+  SoundFile* soundFile = &TrackTable::get(state.currentTrack);
 
   int32_t winWidth = state.win->getWidth();
   int32_t winHeight = state.win->getHeight();
@@ -1962,7 +2043,7 @@ void renderOnTrack() {
   }
   // Thumbnail
   {
-    LfTexture thumbnail = state.onTrackTab.trackThumbnail.width == 0 ? state.icons["music_note"] : state.onTrackTab.trackThumbnail;
+    LfTexture thumbnail = getTrackThumbnail();
     float thumbnailAspect = (float)thumbnail.width / (float)thumbnail.height;
     float containerAspect = (float)containerSize / (float)containerSize;
     float scaleFactor;
@@ -1984,8 +2065,8 @@ void renderOnTrack() {
 
   // Title
   {
-    std::string filename = soundFile->title == "" ? 
-      removeFileExtensionW(soundFile->path.filename().string()) : soundFile->title;
+    std::string filename = soundFile->title().empty() ? 
+      removeFileExtensionW(soundFile->filename()) : soundFile->title();
 
     float textWidth = lf_text_dimension(filename.c_str()).x; 
     if(textWidth > containerSize) {
@@ -2003,7 +2084,7 @@ void renderOnTrack() {
 
   // Arist
   {
-    std::string artist = soundFile->artist == "" ? "-" : soundFile->artist;
+    std::string artist = soundFile->artist() == "" ? "-" : soundFile->artist();
 
     float textWidth = lf_text_dimension(artist.c_str()).x; 
     lf_set_ptr_x_absolute((winWidth - textWidth) / 2.0f);
@@ -2180,10 +2261,7 @@ void renderOnTrack() {
     lf_unset_image_color();
   }
   beginBottomNavBar();
-  backButtonTo(state.previousTab, [&](){
-      if(state.onTrackTab.trackThumbnail.width != 0)
-      lf_free_texture(&state.onTrackTab.trackThumbnail);
-      });   
+  backButtonTo(state.previousTab);
   renderTrackMenu();
   lf_div_end();
 }
@@ -2195,7 +2273,7 @@ void renderTrackFullscreen() {
 
   lf_rect_render((vec2s){0.0f, 0.0f}, (vec2s){(float)containerSize.x, (float)containerSize.y}, LF_BLACK, LF_NO_COLOR, 0.0f, 0.0f);
 
-  LfTexture thumbnail = state.onTrackTab.trackThumbnail.width == 0 ? state.icons["music_note"] : state.onTrackTab.trackThumbnail;
+  LfTexture thumbnail = getTrackThumbnail();
   float thumbnailAspect = (float)thumbnail.width / (float)thumbnail.height;
   float containerAspect = (float)containerSize.x / (float)containerSize.y;
   float scaleFactor;
@@ -2214,7 +2292,7 @@ void renderTrackFullscreen() {
 
 
   if(state.trackFullscreenTab.showUI) {
-    renderTextRaw((vec2s){DIV_START_X, DIV_START_Y}, state.currentSoundFile->title.c_str(), lf_get_theme().font, LF_WHITE);
+    renderTextRaw((vec2s){DIV_START_X, DIV_START_Y}, TrackTable::get(state.currentTrack).title().c_str(), lf_get_theme().font, LF_WHITE);
     lf_div_end();
     lf_div_begin(((vec2s){DIV_START_X, state.win->getHeight() - BACK_BUTTON_HEIGHT - 45 - DIV_START_Y * 2}), ((vec2s){(float)state.win->getWidth(), BACK_BUTTON_HEIGHT + 45 + DIV_START_Y * 2}),
         false);
@@ -2314,22 +2392,13 @@ static void renderTopBarAddFromFolder() {
   lf_push_style_props(props);
   LfClickableItemState addAllButton = lf_button("Add All");
   if(addAllButton == LF_CLICKED) {
-    if(!state.playlistFileThumbnailData.empty()) {
-      state.playlistFileThumbnailData.clear();
-    }
-    state.playlistAddFromFolderTab.addedFile = true;
-    Playlist& currentPlaylist = state.playlists[state.currentPlaylist];
-    std::ofstream metadata(currentPlaylist.path.string() + "/.metadata", std::ios::app);
-    metadata.seekp(0, std::ios::end);
+    std::vector<std::filesystem::path> paths;
     for(const auto& entry : tab.folderContents) {
-      if(!entry.is_directory() && 
-          !Playlist::metadataContainsFile(entry.path().string(), state.currentPlaylist) && 
-          SoundTagParser::isValidSoundFile(entry.path().string())) {
-        metadata << "\"" << entry.path().string() << "\" ";
-        state.loadedPlaylistFilepaths.push_back(entry.path().string());
+      if(!entry.is_directory()) {
+        paths.emplace_back(entry.path());
       }
     }
-    metadata.close();
+    Playlist::addFiles(paths, state.currentPlaylist);
   }
   lf_pop_style_props();
 }
@@ -2354,8 +2423,7 @@ void renderPlaylistAddFromFolder() {
       if(entry.is_directory()) {
       PlaylistAddFromFolderTab& tab = state.playlistAddFromFolderTab;
       tab.currentFolderPath = entry.path().string();
-      tab.folderContents.clear();
-      tab.folderContents = loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+      loadFolderContentsAsync(tab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
       lf_set_current_div_scroll(0.0f);
       lf_set_current_div_scroll_velocity(0.0f);
       }
@@ -2363,8 +2431,7 @@ void renderPlaylistAddFromFolder() {
       [&](){
       PlaylistAddFromFolderTab& tab = state.playlistAddFromFolderTab;
       tab.currentFolderPath = std::filesystem::path(tab.currentFolderPath).parent_path().string();
-      tab.folderContents.clear();
-      tab.folderContents = loadFolderContents(state.playlistAddFromFolderTab.currentFolderPath);
+      loadFolderContentsAsync(tab.folderContents, state.playlistAddFromFolderTab.currentFolderPath);
       },
       renderTopBarAddFromFolder,
       [&](std::filesystem::directory_entry entry, bool hovered){
@@ -2374,7 +2441,7 @@ void renderPlaylistAddFromFolder() {
       props.color = LF_NO_COLOR;
       props.padding = 2.5f;
       props.border_width = 0.0f;
-      lf_set_image_color((Playlist::metadataContainsFile(entry.path().string(), state.currentPlaylist) && !entry.is_directory()) ? LYSSA_GREEN : LF_WHITE);
+      lf_set_image_color((!entry.is_directory() && Playlist::containsFile(entry.path(), state.currentPlaylist)) ? LYSSA_GREEN : LF_WHITE);
       lf_push_style_props(props);
       const vec2s iconSize = (vec2s){25, 25};
       LfTexture icon = (LfTexture){
@@ -2382,14 +2449,8 @@ void renderPlaylistAddFromFolder() {
           .width = (uint32_t)iconSize.x, 
           .height = (uint32_t)iconSize.y
       };
-      if(lf_image_button(icon) == LF_CLICKED && !entry.is_directory() && 
-          !Playlist::metadataContainsFile(entry.path().string(), state.currentPlaylist) && 
-          SoundTagParser::isValidSoundFile(entry.path().string())) {
-        std::ofstream metadata(state.playlists[state.currentPlaylist].path.string() + "/.metadata", std::ios::app);
-        metadata.seekp(0, std::ios::end);
-        metadata << "\"" << entry.path().string() << "\" ";
-        state.loadedPlaylistFilepaths.push_back(entry.path().string());
-        state.playlistAddFromFolderTab.addedFile = true;
+      if(lf_image_button(icon) == LF_CLICKED && !entry.is_directory()) {
+        Playlist::addFiles({entry.path()}, state.currentPlaylist);
       }
       lf_pop_style_props();
       lf_unset_image_color();
@@ -2399,25 +2460,8 @@ void renderPlaylistAddFromFolder() {
 
 
   beginBottomNavBar();
-  backButtonTo(state.previousTab, [&](){
-      if(state.playlistAddFromFolderTab.addedFile) {
-      if(state.soundHandler.isInit) {
-      state.soundHandler.stop();
-      state.soundHandler.uninit();
-      state.currentSoundFile = nullptr;
-      }
-      Playlist& playlist = state.playlists[state.currentPlaylist];
-
-      playlist.musicFiles.clear();
-      playlist.musicFiles.shrink_to_fit();
-      state.loadedPlaylistFilepaths.clear();
-      state.loadedPlaylistFilepaths.shrink_to_fit();
-
-      state.loadedPlaylistFilepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(playlist.path));
-      loadPlaylistAsync(playlist);
-      state.playlistAddFromFolderTab.addedFile = false;
-      }
-      });
+  // Added files are appended to the loaded playlist when their batch is merged
+  backButtonTo(state.previousTab);
   renderTrackMenu();
   lf_div_end();
 }
@@ -2438,14 +2482,13 @@ static void renderPlaylistSetThumbnail() {
 
     if(currentPath.empty()) {
       currentPath = std::string(getenv(HOMEDIR));
-      folderContents = loadFolderContents(currentPath);
+      loadFolderContentsAsync(folderContents, currentPath);
     }
     renderFileDialogue(
         [&](std::filesystem::directory_entry entry){
         if(entry.is_directory()) {
         currentPath = entry.path().string();
-        folderContents.clear();
-        folderContents = loadFolderContents(currentPath);
+        loadFolderContentsAsync(folderContents, currentPath);
         lf_set_current_div_scroll(0.0f);
         lf_set_current_div_scroll_velocity(0.0f);
         } else if(entry.is_regular_file()) {
@@ -2453,27 +2496,15 @@ static void renderPlaylistSetThumbnail() {
             state.createPlaylistTab.thumbnailPath = entry.path().string();
           else if(state.previousTab == GuiTab::Dashboard) {
             Playlist& currentPlaylist = state.playlists[state.currentPlaylist]; 
-            currentPlaylist.thumbnailPath = entry.path().string();
             currentPlaylist.thumbnail = lf_load_texture(entry.path().string().c_str(), false, LF_TEX_FILTER_LINEAR); 
-            bool playlistEmpty = currentPlaylist.musicFiles.empty();
-            if(playlistEmpty) {
-              for(auto& filepath : PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(currentPlaylist.path))) {
-                currentPlaylist.musicFiles.emplace_back((SoundFile){.path = filepath});
-              }
-            }
-            Playlist::save(state.currentPlaylist);
-            if(playlistEmpty) {
-              currentPlaylist.musicFiles.clear();
-              currentPlaylist.musicFiles.shrink_to_fit();
-            }
+            Playlist::changeThumbnail(entry.path(), state.currentPlaylist);
           }
           changeTabTo(state.previousTab);
         }
         },
         [&](){
         currentPath = std::filesystem::path(currentPath).parent_path().string();
-        folderContents.clear();
-        folderContents = loadFolderContents(currentPath);
+        loadFolderContentsAsync(folderContents, currentPath);
         },
         nullptr, 
         nullptr,
@@ -2502,7 +2533,7 @@ void renderSearchPlaylist() {
 
   lf_next_line();
   bool clickedThumbnail = false;
-  SoundFile clickedSoundFile;
+  std::filesystem::path clickedPath;
   if (!state.searchPlaylistResults.empty()) {
     lf_div_begin(LF_PTR, ((vec2s){(float)state.win->getWidth() - DIV_START_X * 2 - state.sideNavigationWidth, 
           (float)state.win->getHeight() - DIV_START_Y * 2 - lf_get_ptr_y() - 
@@ -2515,22 +2546,20 @@ void renderSearchPlaylist() {
     const float cornerRadius = 6.0f;
 
     uint32_t resIdx = 0;
-    for(auto& res : state.searchPlaylistResults) {
-      LfClickableItemState thumbnailState = renderSoundFileThumbnail((vec2s){size.x, size.x}, res, nullptr, true, 4.0f); 
+    for(TrackId id : state.searchPlaylistResults) {
+      SoundFile& res = TrackTable::get(id);
+      LfClickableItemState thumbnailState = renderSoundFileThumbnail((vec2s){size.x, size.x}, id, nullptr, true, 4.0f); 
       if(thumbnailState == LF_CLICKED) {
-        state.currentSoundFile = &res;
-        if(state.onTrackTab.trackThumbnail.width != 0) {
-          lf_free_texture(&state.onTrackTab.trackThumbnail);
-        }
-        state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path, (vec2s){-1, -1});
+        state.currentTrack = id;
+        loadTrackThumbnail(res.path());
         changeTabTo(GuiTab::OnTrack);
         playlistPlayFileWithIndex(resIdx, state.currentPlaylist);
       }
       lf_set_cull_end_x(lf_get_ptr_x());
-      renderTextRaw((vec2s){lf_get_ptr_x() - size.x, lf_get_ptr_y() + size.x + (margin / 3.0f)}, res.title.c_str(),
+      renderTextRaw((vec2s){lf_get_ptr_x() - size.x, lf_get_ptr_y() + size.x + (margin / 3.0f)}, res.title().c_str(),
           state.h6Font, LF_WHITE);
 
-      renderTextRaw((vec2s){lf_get_ptr_x() - size.x, lf_get_ptr_y() + size.x + state.h6Font.font_size + (margin / 3.0f)}, res.artist.c_str(),
+      renderTextRaw((vec2s){lf_get_ptr_x() - size.x, lf_get_ptr_y() + size.x + state.h6Font.font_size + (margin / 3.0f)}, res.artist().c_str(),
           state.h6Font, lf_color_brightness(GRAY, 1.4f));
       lf_unset_cull_end_x();
 
@@ -2541,7 +2570,7 @@ void renderSearchPlaylist() {
       }
       if(thumbnailState == LF_HOVERED && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_RIGHT)) {
         clickedThumbnail = true;
-        clickedSoundFile = res;
+        clickedPath = res.path();
       }
       resIdx++;
     }
@@ -2567,7 +2596,7 @@ void renderSearchPlaylist() {
       lf_pop_style_props();
   } 
   if(clickedThumbnail) {
-    state.popups[PopupType::PlaylistFileDialoguePopup] = std::make_unique<PlaylistFileDialoguePopup>(clickedSoundFile.path, 
+    state.popups[PopupType::PlaylistFileDialoguePopup] = std::make_unique<PlaylistFileDialoguePopup>(clickedPath, 
         (vec2s){(float)lf_get_mouse_x() + 10, (float)lf_get_mouse_y() + 10});
     state.popups[PopupType::PlaylistFileDialoguePopup]->shouldRender = true;
   }
@@ -2711,19 +2740,21 @@ void renderSearchAll() {
 }
 
 void renderTrackDisplay() {
-  if(state.currentSoundFile == NULL) return;
+  if(state.currentTrack == TRACK_ID_NONE) return;
+  SoundFile& currentFile = TrackTable::get(state.currentTrack);
   const float margin = DIV_START_X;
   const float marginThumbnail = 15;
   const vec2s thumbnailContainerSize = PLAYLIST_FILE_THUMBNAIL_SIZE;
   const float padding = 10;
 
-  std::filesystem::path filepath = state.currentSoundFile->path;
+  std::filesystem::path filepath = currentFile.path();
 
-  std::string filename = state.currentSoundFile->title == "" ? 
-    removeFileExtensionW(state.currentSoundFile->path.filename().string()) : state.currentSoundFile->title;
-  std::string artist = state.currentSoundFile->artist;
+  std::string filename = currentFile.title().empty() ? 
+    removeFileExtensionW(currentFile.filename()) : currentFile.title();
+  std::string artist = currentFile.artist();
 
-  SoundFile& playingFile = state.playlists[state.playingPlaylist].musicFiles[state.playlists[state.playingPlaylist].playingFile];
+  const Playlist& playingPlaylist = state.playlists[state.playingPlaylist];
+  TrackId playingTrack = playingPlaylist.tracks[playingPlaylist.playingFile];
 
   // Container 
   float containerPosX = (float)(state.win->getWidth() - state.trackProgressSlider.width) / 2.0f + state.trackProgressSlider.width + 
@@ -2744,7 +2775,7 @@ void renderTrackDisplay() {
   {
     lf_set_ptr_x_absolute(containerPos.x + padding);
     lf_set_ptr_y_absolute(containerPos.y + padding);
-    renderSoundFileThumbnail(thumbnailContainerSize, playingFile);
+    renderSoundFileThumbnail(thumbnailContainerSize, playingTrack);
   }
   // Name + Artist
   {
@@ -2765,7 +2796,7 @@ void renderTrackDisplay() {
   }
 }
 void renderTrackProgress(bool dark) {
-  if(state.currentSoundFile == NULL) return;
+  if(state.currentTrack == TRACK_ID_NONE) return;
   // Progress position in seconds
   state.trackProgressSlider.width = state.win->getWidth() / 2.5f;
   state.trackProgressSlider.height = 5.0f;
@@ -3001,90 +3032,39 @@ void loadPlaylists() {
 
   if(std::find(state.playlists.begin(), state.playlists.end(), (Playlist){.path = LYSSA_DIR + "/playlists/favourites"}) == state.playlists.end()) {
     std::string favouritesDir = LYSSA_DIR + "/playlists/favourites";
+    PlaylistFile::migrate(favouritesDir);
     Playlist favourites;
     favourites.path = favouritesDir;
-    favourites.name = PlaylistMetadata::getName(std::filesystem::directory_entry(favouritesDir));
-    favourites.desc = PlaylistMetadata::getDesc(std::filesystem::directory_entry(favouritesDir));
+    PlaylistInfo info = PlaylistMetadata::getInfo(std::filesystem::directory_entry(favouritesDir));
+    favourites.name = info.name;
+    favourites.desc = info.desc;
     favourites.url = "";
     favourites.thumbnailPath = "";
-    state.playlists.emplace_back(favourites);
+    favourites.id = PlaylistMembership::registerPlaylist(favourites.path);
+    Playlist::add(favourites);
   }
 
   for (const auto& folder : std::filesystem::directory_iterator(LYSSA_DIR + "/playlists/")) {
     if(folder.path().filename() == "favourites") continue;
     Playlist playlist{};
     playlist.path = folder.path().string();
-    playlist.name = PlaylistMetadata::getName(folder);
-    playlist.desc = PlaylistMetadata::getDesc(folder);
-    playlist.url = PlaylistMetadata::getUrl(folder);
-    playlist.thumbnailPath = PlaylistMetadata::getThumbnailPath(folder);
+    // Playlists are compared by path, known ones are not read again
     if(std::find(state.playlists.begin(), state.playlists.end(), playlist) == state.playlists.end()) {
+      PlaylistFile::migrate(folder.path());
+      PlaylistInfo info = PlaylistMetadata::getInfo(folder);
+      playlist.name = info.name;
+      playlist.desc = info.desc;
+      playlist.url = info.url;
+      playlist.thumbnailPath = info.thumbnailPath;
       if(playlist.thumbnailPath != "") {
-        playlist.thumbnail = lf_load_texture_resized(playlist.thumbnailPath.string().c_str(), false, LF_TEX_FILTER_LINEAR, 180, 180);
+        playlist.thumbnail = lf_load_texture_resized(playlist.thumbnailPath.string().c_str(), false, LF_TEX_FILTER_LINEAR, THUMBNAIL_CARD_SIZE, THUMBNAIL_CARD_SIZE);
       }
-      state.playlists.emplace_back(playlist);
+      playlist.id = PlaylistMembership::registerPlaylist(playlist.path);
+      Playlist::add(playlist);
     }
   }
 }
 
-void loadPlaylistFileAsync(std::vector<SoundFile>* files, std::string path) {
-  std::lock_guard<std::mutex> lock(state.mutex);
-  SoundFile file{};
-  if(std::filesystem::exists(path)) {
-    file.path = std::filesystem::path(path); 
-    file.thumbnail = (LfTexture){0};
-    file.duration = SoundTagParser::getSoundDuration(path);
-    file.artist = SoundTagParser::getSoundArtist(path);
-    file.title = SoundTagParser::getSoundTitle(path);
-    file.releaseYear = SoundTagParser::getSoundReleaseYear(path);
-  } else {
-    file.path = "File cannot be loaded";
-    file.thumbnail = (LfTexture){0};
-    file.duration = 0; 
-  }
-  files->emplace_back(file);
-  if(std::filesystem::exists(path)) {
-    state.playlistFileThumbnailData.emplace_back(SoundTagParser::getSoundThubmnailData(path, PLAYLIST_FILE_THUMBNAIL_SIZE));
-  } else {
-    state.playlistFileThumbnailData.emplace_back((TextureData){0});
-  }
-}
-
-void addFileToPlaylistAsync(std::vector<SoundFile>* files, std::string path, uint32_t playlistIndex) {
-  std::lock_guard<std::mutex> lock(state.mutex);
-  Playlist& playlist = state.playlists[playlistIndex];
-
-  std::ofstream metadata(playlist.path.string() + "/.metadata", std::ios::app);
-
-  if(!metadata.is_open()) return;
-
-  std::ifstream playlistFile(path);
-  if(!playlistFile.good()) return;
-
-  metadata << std::string("\"" + path + "\" ");
-  metadata.close();
-
-  SoundFile file{};
-  if(std::filesystem::exists(path)) {
-    file.path = std::filesystem::path(path); 
-    file.thumbnail = (LfTexture){0};
-    file.duration = SoundTagParser::getSoundDuration(path);
-    file.artist = SoundTagParser::getSoundArtist(path);
-    file.title = SoundTagParser::getSoundTitle(path);
-    file.releaseYear = SoundTagParser::getSoundReleaseYear(path);
-  } else {
-    file.path = "File cannot be loaded";
-    file.thumbnail = (LfTexture){0};
-    file.duration = 0; 
-  }
-  files->emplace_back(file);
-  if(std::filesystem::exists(path)) {
-    state.playlistFileThumbnailData.emplace_back(SoundTagParser::getSoundThubmnailData(path, PLAYLIST_FILE_THUMBNAIL_SIZE));
-  } else {
-    state.playlistFileThumbnailData.emplace_back((TextureData){0});
-  }
-}
-
 std::vector<std::string> loadFilesFromFolder(const std::filesystem::path& folderPath) {
   std::vector<std::string> files;
   for (const auto& entry : std::filesystem::directory_iterator(folderPath)) {
@@ -3097,24 +3077,39 @@ std::vector<std::string> loadFilesFromFolder(const std::filesystem::path& folder
   return files;
 }
 
+// Index of a row after the row at fromIndex was moved to toIndex
+static int32_t movedRowIndex(int32_t i, uint32_t fromIndex, uint32_t toIndex) {
+  if(i < 0) return i;
+  if(i == (int32_t)fromIndex) return toIndex;
+  if(fromIndex < toIndex && i > (int32_t)fromIndex && i <= (int32_t)toIndex) return i - 1;
+  if(toIndex < fromIndex && i >= (int32_t)toIndex && i < (int32_t)fromIndex) return i + 1;
+  return i;
+}
+
 void moveFileInPlaylistIdx(uint32_t playlistIndex, uint32_t fromIndex, uint32_t toIndex) {
-  std::vector<SoundFile>& files = state.playlists[playlistIndex].musicFiles;
-  if (fromIndex < 0 || fromIndex >= files.size() || toIndex < 0 || toIndex >= files.size()) {
+  Playlist& playlist = state.playlists[playlistIndex];
+  std::vector<TrackId>& files = playlist.tracks;
+  if (fromIndex >= files.size() || toIndex >= files.size()) {
     LOG_ERROR("Index out of range. files.size(): %i, fromIndex: %i, toIndex: %i", (int32_t)files.size(), fromIndex, toIndex);
+    return;
   }
+  if(fromIndex == toIndex) return;
 
-  SoundFile element = files[fromIndex];
+  // Persisted as a single journal record
+  PlaylistFile::moveFile(playlist.path, TrackTable::get(files[fromIndex]).path().string(),
+      TrackTable::get(files[toIndex]).path().string(), fromIndex < toIndex);
+
+  // Shifts the 4 byte IDs between both rows in one pass
   if (fromIndex < toIndex) {
-    files.insert(files.begin() + toIndex + 1, element);
-    files.erase(files.begin() + fromIndex);
+    std::rotate(files.begin() + fromIndex, files.begin() + fromIndex + 1, files.begin() + toIndex + 1);
   } else {
-    files.erase(files.begin() + fromIndex);
-    files.insert(files.begin() + toIndex, element);
+    std::rotate(files.begin() + toIndex, files.begin() + fromIndex, files.begin() + fromIndex + 1);
   }
+  playlist.playingFile = movedRowIndex(playlist.playingFile, fromIndex, toIndex);
+  playlist.selectedFile = movedRowIndex(playlist.selectedFile, fromIndex, toIndex);
 }
 
 void playlistPlayFileWithIndex(uint32_t i, uint32_t playlistIndex) {
-  if(!state.playlistFileFutures.empty()) return;
   Playlist& playlist = state.playlists[playlistIndex];
   playlist.playingFile = i;
   playlist.selectedFile = i;
@@ -3125,7 +3120,7 @@ void playlistPlayFileWithIndex(uint32_t i, uint32_t playlistIndex) {
   if(state.soundHandler.isInit)
     state.soundHandler.uninit();
 
-  state.soundHandler.init(playlist.musicFiles[i].path.string(), miniaudioDataCallback);
+  state.soundHandler.init(playlist.file(i).path().string(), miniaudioDataCallback);
   state.soundHandler.play();
 
   state.currentSoundPos = 0.0;
@@ -3133,13 +3128,15 @@ void playlistPlayFileWithIndex(uint32_t i, uint32_t playlistIndex) {
 
   if(state.playingPlaylist != playlistIndex) {
     state.alreadyPlayedTracks.clear();
+    // Warmed at the next start
+    saveLastPlaylist(playlist.path);
   }
   state.playingPlaylist = playlistIndex;
 
   if(std::find(state.alreadyPlayedTracks.begin(), state.alreadyPlayedTracks.end(), i) == state.alreadyPlayedTracks.end()) {
     state.alreadyPlayedTracks.push_back(i);
   }
-  if(state.alreadyPlayedTracks.size() >= state.playlists[state.currentPlaylist].musicFiles.size()) {
+  if(state.alreadyPlayedTracks.size() >= state.playlists[state.currentPlaylist].tracks.size()) {
     state.alreadyPlayedTracks.clear();
   }
 }
@@ -3148,28 +3145,25 @@ void skipSoundUp(uint32_t playlistInedx) {
   Playlist& playlist = state.playlists[playlistInedx];
 
   if(!state.shuffle) {
-    if(playlist.playingFile + 1 < playlist.musicFiles.size())
+    if(playlist.playingFile + 1 < playlist.tracks.size())
       playlist.playingFile++;
     else 
       playlist.playingFile = 0;
   } else {
-    RandomEngine random(0, playlist.musicFiles.size() - 1);
+    RandomEngine random(0, playlist.tracks.size() - 1);
     playlist.playingFile = random.randInt();
     while(std::find(state.alreadyPlayedTracks.begin(), state.alreadyPlayedTracks.end(), playlist.playingFile) != state.alreadyPlayedTracks.end()) {
       playlist.playingFile = random.randInt();
     }
   }
 
-  state.currentSoundFile = &playlist.musicFiles[playlist.playingFile];
+  state.currentTrack = playlist.tracks[playlist.playingFile];
   if(state.currentTab == GuiTab::OnTrack || state.currentTab == GuiTab::TrackFullscreen) {
-    if(state.onTrackTab.trackThumbnail.width != 0) {
-      lf_free_texture(&state.onTrackTab.trackThumbnail);
-    }
-    state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path);
+    loadTrackThumbnail(TrackTable::get(state.currentTrack).path());
   }
 
   playlistPlayFileWithIndex(playlist.playingFile, playlistInedx);
-  float filePosY = playlist.musicFiles[playlist.playingFile].renderPosY;
+  float filePosY = playlist.rowPosY(playlist.playingFile);
   playlist.scroll = -filePosY;
 }
 
@@ -3179,17 +3173,15 @@ void skipSoundDown(uint32_t playlistIndex) {
   if(playlist.playingFile - 1 >= 0)
     playlist.playingFile--;
   else 
-    playlist.playingFile = playlist.musicFiles.size() - 1; 
+    playlist.playingFile = playlist.tracks.size() - 1; 
 
-  state.currentSoundFile = &playlist.musicFiles[playlist.playingFile];
+  state.currentTrack = playlist.tracks[playlist.playingFile];
   if(state.currentTab == GuiTab::OnTrack || state.currentTab == GuiTab::TrackFullscreen) {
-    if(state.onTrackTab.trackThumbnail.width != 0)
-      lf_free_texture(&state.onTrackTab.trackThumbnail);
-    state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path);
+    loadTrackThumbnail(TrackTable::get(state.currentTrack).path());
   }
 
   playlistPlayFileWithIndex(playlist.playingFile, playlistIndex);
-  float filePosY = playlist.musicFiles[playlist.playingFile].renderPosY;
+  float filePosY = playlist.rowPosY(playlist.playingFile);
   playlist.scroll = -filePosY;
 }
 void updateSoundProgress() {
@@ -3229,9 +3221,9 @@ void terminateAudio() {
   if(!state.soundHandler.isInit || !ASYNC_PLAYLIST_LOADING) return;
   state.soundHandler.stop();
   state.soundHandler.uninit();
-  state.previousSoundFile = state.currentSoundFile;
+  state.previousTrack = state.currentTrack;
   state.previousSoundPos = state.currentSoundPos;
-  state.currentSoundFile = nullptr;
+  state.currentTrack = TRACK_ID_NONE;
   state.playlists[state.currentPlaylist].playingFile = -1;
 }
 
@@ -3254,128 +3246,229 @@ void loadIcons() {
   }
 }
 
-bool playlistFileOrderCorrect(uint32_t playlistIndex, const std::vector<std::string>& paths) {
-  const std::vector<SoundFile>& soundFiles = state.playlists[playlistIndex].musicFiles;
+void loadTrackThumbnail(const std::filesystem::path& path) {
+  // The full resolution level goes through the ThumbnailCache, so a cover is
+  // decoded once and shared by every track that has it
+  state.onTrackTab.trackThumbnailPath = path;
+  ThumbnailCache::requestTexture(path, ThumbnailLevel::Full);
+}
 
-  if (soundFiles.size() != paths.size()) {
-    return false;
-  }
+LfTexture getTrackThumbnail() {
+  LfTexture thumbnail = ThumbnailCache::requestTexture(state.onTrackTab.trackThumbnailPath, ThumbnailLevel::Full);
+  return thumbnail.width == 0 ? state.icons["music_note"] : thumbnail;
+}
 
-  for (size_t i = 0; i < soundFiles.size(); ++i) {
-    if (soundFiles[i].path != paths[i]) {
-      return false;
-    }
+// The interned filename without its extension, nothing is copied
+static std::string_view filenameStem(const std::string& filename) {
+  size_t lastDotIndex = filename.rfind('.');
+  if(lastDotIndex != std::string::npos && lastDotIndex > 0) {
+    return std::string_view(filename).substr(0, lastDotIndex);
   }
+  return filename;
+}
 
-  return true;
+static bool compareTracksByName(TrackId a, TrackId b) {
+  return filenameStem(TrackTable::get(a).filename()) < filenameStem(TrackTable::get(b).filename());
 }
 
-std::vector<SoundFile> reorderPlaylistFiles(const std::vector<SoundFile>& soundFiles, const std::vector<std::string>& paths) {
-  std::vector<SoundFile> reorderedVector;
-  reorderedVector.reserve(soundFiles.size());
+static bool mergeAddedFiles(Playlist& playlist) {
+  PlaylistLoadContext& loader = *playlist.loader;
+  if(loader.addFutures.empty()) return false;
+  for(auto& future : loader.addFutures) {
+    if(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+  }
+  for (auto &future : loader.addFutures) {
+    future.get();
+  } 
+  loader.addFutures.clear(); 
 
-  for (const auto& path : paths) {
-    for (const auto& file : soundFiles) {
-      if (file.path == path) {
-        reorderedVector.emplace_back(file);
-        break;
-      }
+  // The added tracks are loaded like the rest of the playlist, so their
+  // covers are uploaded under the frame budget as well
+  std::vector<TrackId> loadTracks;
+  for(const AddedTrack& added : loader.addedTracks) {
+    if(!added.valid) {
+      PlaylistMembership::remove(added.id, playlist.id);
+      continue;
+    }
+    playlist.tracks.emplace_back(added.id);
+    if(!TrackTable::get(added.id).loaded) {
+      loadTracks.emplace_back(added.id);
     }
   }
+  TrackLoader::load(loadTracks);
+  loader.addedTracks.clear();
+  loader.addDone = 0;
+  loader.addTotal = 0;
+  return true;
+}
 
-  return reorderedVector;
+static bool isPlaylistOnScreen(uint32_t playlistIndex) {
+  if((int32_t)playlistIndex != state.currentPlaylist) return false;
+  switch(state.currentTab) {
+    case GuiTab::OnPlaylist:
+    case GuiTab::OnTrack:
+    case GuiTab::TrackFullscreen:
+    case GuiTab::PlaylistAddFromFile:
+    case GuiTab::PlaylistAddFromFolder:
+    case GuiTab::PlaylistSetThumbnail:
+    case GuiTab::SearchPlaylist:
+      return true;
+    case GuiTab::Dashboard:
+      return state.dashboardTab == DashboardTab::Favourites;
+    default:
+      return false;
+  }
 }
 
-static bool compareSoundFilesByName(const SoundFile& a, const SoundFile& b) {
-    std::string filenameA = removeFileExtensionW(a.path.filename().string());
-    std::string filenameB = removeFileExtensionW(b.path.filename().string());
-    return filenameA < filenameB;
+static void resumePlaylistLoad(Playlist& playlist) {
+  std::vector<TrackId> loadTracks;
+  for(TrackId id : playlist.tracks) {
+    if(!TrackTable::get(id).loaded) loadTracks.emplace_back(id);
+  }
+  playlist.loader->generation = TrackLoader::load(loadTracks);
+  playlist.loader->cancelled = false;
 }
-static bool compareTextureDataByName(const TextureData& a, const TextureData& b) {
-    return removeFileExtension(a.path.filename()) < removeFileExtension(b.path.filename());
+
+// Loads of playlists that left the screen are cancelled, so the workers only
+// serve what is shown and what is warmed in the background
+static void updatePlaylistLoads() {
+  for(uint32_t i = 0; i < state.playlists.size(); i++) {
+    PlaylistLoadContext& loader = *state.playlists[i].loader;
+    if(loader.generation != LOAD_GENERATION_NONE && !TrackLoader::isLoading(loader.generation)) {
+      loader.generation = LOAD_GENERATION_NONE;
+      loader.background = false;
+    }
+    bool onScreen = isPlaylistOnScreen(i);
+    if(loader.generation != LOAD_GENERATION_NONE && !onScreen && !loader.background) {
+      TrackLoader::cancel(loader.generation);
+      loader.generation = LOAD_GENERATION_NONE;
+      loader.cancelled = true;
+    } else if(loader.cancelled && onScreen) {
+      resumePlaylistLoad(state.playlists[i]);
+    }
+  }
 }
 
 void handleAsyncPlaylistLoading() {
-  for (uint32_t i = 0; i < state.playlistFileThumbnailData.size(); i++) {
-    SoundFile& file = state.playlists[state.currentPlaylist].musicFiles[i];
-    if(file.loaded) continue;
-    file.loaded = true;
-  }
-  if(state.loadedPlaylistFilepaths.size() == state.playlists[state.currentPlaylist].musicFiles.size() && !state.playlistFileFutures.empty()) {
-    // Create OpenGL Textures for the thumbnails that were loaded
-    for (uint32_t i = 0; i < state.playlistFileThumbnailData.size(); i++) {
-      SoundFile& file = state.playlists[state.currentPlaylist].musicFiles[i];
-      LfTexture& thumbnail = file.thumbnail;
-      TextureData data = state.playlistFileThumbnailData[i];
-      lf_create_texture_from_image_data(LF_TEX_FILTER_LINEAR, &thumbnail.id, data.width, data.height, data.channels, data.data);
-      thumbnail.width = data.width;
-      thumbnail.height = data.height;
-    } 
-    if(state.currentPlaylist != -1) {
-      for (auto &future : state.playlistFileFutures) {
-        future.get(); // Wait for each future to complete
-      } 
-      state.playlistFileFutures.clear(); 
-      Playlist& playlist = state.playlists[state.currentPlaylist];
-      std::sort(playlist.musicFiles.begin(), playlist.musicFiles.end(), compareSoundFilesByName);
-      std::sort(state.playlistFileThumbnailData.begin(), state.playlistFileThumbnailData.end(), compareTextureDataByName);
-
-      if(state.previousSoundFile) {
-        Playlist& playingPlaylist = state.playlists[state.playingPlaylist];
-        auto it = std::find(playingPlaylist.musicFiles.begin(), playingPlaylist.musicFiles.end(), (SoundFile){.path = state.previousSoundFile->path});
-        if(it != playingPlaylist.musicFiles.end()) {
-          uint32_t index = std::distance(playingPlaylist.musicFiles.begin(), it);
-          playlistPlayFileWithIndex(index, state.playingPlaylist);
-          state.currentSoundFile = state.previousSoundFile;
-          state.currentSoundPos = state.previousSoundPos;
-          state.soundHandler.setPositionInSeconds(state.currentSoundPos);
-        }
-      }
+  updatePlaylistLoads();
+  bool loadedTracks = TrackLoader::poll();
+  bool addedFiles = false, addingFiles = false;
+  for(Playlist& playlist : state.playlists) {
+    addedFiles |= mergeAddedFiles(playlist);
+    addingFiles |= !playlist.loader->addFutures.empty();
+  }
+  if(!loadedTracks && !addedFiles) return;
+  if(addingFiles || TrackLoader::isLoading()) return;
+
+  if(state.playingPlaylist != -1 && state.previousTrack != TRACK_ID_NONE) {
+    // Track IDs are stable, only the row of the track is looked up
+    Playlist& playingPlaylist = state.playlists[state.playingPlaylist];
+    for(uint32_t i = 0; i < playingPlaylist.tracks.size(); i++) {
+      if(playingPlaylist.tracks[i] != state.previousTrack) continue;
+      playlistPlayFileWithIndex(i, state.playingPlaylist);
+      state.currentTrack = state.previousTrack;
+      state.currentSoundPos = state.previousSoundPos;
+      state.soundHandler.setPositionInSeconds(state.currentSoundPos);
+      break;
     }
+    state.previousTrack = TRACK_ID_NONE;
   }
 }
 
 void loadPlaylistAsync(Playlist& playlist) {
-  playlist.musicFiles.clear();
-  state.playlistFileThumbnailData.clear();
-  state.playlistFileThumbnailData.shrink_to_fit();
-
-
-  for(auto& path : state.loadedPlaylistFilepaths) {
-    if(!Playlist::containsFile(path, state.currentPlaylist)){ 
-      if(ASYNC_PLAYLIST_LOADING) {
-        state.playlistFileFutures.emplace_back(std::async(std::launch::async, loadPlaylistFileAsync, &state.playlists[state.currentPlaylist].musicFiles, path));
-     } else {
-        SoundFile file;
-        if(std::filesystem::exists(std::filesystem::path(path))) {
-          SoundMetadata metadata = SoundTagParser::getSoundMetadataNoThumbnail(path); 
-          file = (SoundFile){
-            .path = path,
-              .artist = metadata.artist, 
-              .title = metadata.title,
-              .releaseYear = metadata.releaseYear,
-              .duration = static_cast<int32_t>(metadata.duration),
-              .thumbnail = SoundTagParser::getSoundThubmnail(path, PLAYLIST_FILE_THUMBNAIL_SIZE),
-          };
-
-        } else {
-          file = (SoundFile){
-            .path = "File cannot be loaded",
-              .duration = 0, 
-              .thumbnail = (LfTexture){0}
-          };
-        }
-        playlist.musicFiles.emplace_back(file);
+  PlaylistLoadContext& loader = *playlist.loader;
+  loader.filepaths = PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(playlist.path));
+  playlist.tracks.clear();
+
+  std::vector<TrackId> loadTracks;
+  // Duplicate entries of the file are skipped
+  std::unordered_set<TrackId> seenTracks;
+  seenTracks.reserve(loader.filepaths.size());
+  for(auto& path : loader.filepaths) {
+    TrackId id = TrackTable::intern(path);
+    if(!seenTracks.insert(id).second) continue;
+    playlist.tracks.emplace_back(id);
+
+    // Tracks that another playlist loaded already are only looked up
+    SoundFile& track = TrackTable::get(id);
+    if(track.loaded) continue;
+    if(ASYNC_PLAYLIST_LOADING) {
+      loadTracks.emplace_back(id);
+    } else {
+      if(std::filesystem::exists(std::filesystem::path(path))) {
+        SoundMetadata metadata = SoundTagParser::getSoundMetadataNoThumbnail(path); 
+        track.artistId = StringPool::intern(metadata.artist);
+        track.titleId = StringPool::intern(metadata.title);
+        track.releaseYear = metadata.releaseYear;
+        track.duration = static_cast<int32_t>(metadata.duration);
+        track.thumbnail = SoundTagParser::getSoundThubmnail(path, PLAYLIST_FILE_THUMBNAIL_SIZE);
+      } else {
+        track.titleId = StringPool::intern("File cannot be loaded");
       }
+      track.loaded = true;
     }
   }
-  if(!ASYNC_PLAYLIST_LOADING) {
-    std::sort(playlist.musicFiles.begin(), playlist.musicFiles.end(), compareSoundFilesByName);
+  if(loader.generation != LOAD_GENERATION_NONE) {
+    TrackLoader::cancel(loader.generation);
   }
+  loader.generation = TrackLoader::load(loadTracks);
+  loader.cancelled = false;
+  // The order only depends on the paths, so rows are sorted before their metadata arrives
+  std::sort(playlist.tracks.begin(), playlist.tracks.end(), compareTracksByName);
 }
 
-LfClickableItemState renderSoundFileThumbnail(vec2s thumbnailContainerSize, SoundFile& file, const std::function<void()>& clickCb, bool uiResponse, float cornerRadius) {
-  LfTexture thumbnail = (file.thumbnail.width == 0) ? state.icons["music_note"] : file.thumbnail;
+// Written as a job through a temporary file, so a crash never leaves a torn
+// file. A write that was overtaken by a newer one is skipped.
+void saveLastPlaylist(const std::filesystem::path& playlistPath) {
+  static std::atomic<uint64_t> latest{0};
+  static std::mutex writeMutex;
+  uint64_t sequence = ++latest;
+  std::string playlist = playlistPath.string();
+  Jobs::submit<bool>([sequence, playlist]() {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      if(sequence != latest) return true;
+      std::string path = LYSSA_DIR + "/last_playlist";
+      std::string tmpPath = path + ".tmp";
+      {
+        std::ofstream file(tmpPath);
+        file << playlist;
+        if(!file.good()) return false;
+      }
+      std::error_code ec;
+      std::filesystem::rename(tmpPath, path, ec);
+      return !ec;
+      }, 
+      [](bool& saved) {
+      if(!saved) LOG_ERROR("Failed to save the last played playlist.");
+      });
+}
+
+// Loads the playlists that are likely opened first in the background, their
+// loads are not cancelled while they are off screen
+void warmPlaylists() {
+  std::string lastPlaylist;
+  std::getline(std::ifstream(LYSSA_DIR + "/last_playlist"), lastPlaylist);
+  std::string favourites = LYSSA_DIR + "/playlists/favourites";
+
+  for(Playlist& playlist : state.playlists) {
+    if(playlist.loaded || (playlist.path != favourites && playlist.path != lastPlaylist)) continue;
+    loadPlaylistAsync(playlist);
+    playlist.loader->background = true;
+    playlist.loaded = true;
+  }
+}
+
+LfClickableItemState renderSoundFileThumbnail(vec2s thumbnailContainerSize, TrackId id, const std::function<void()>& clickCb, bool uiResponse, float cornerRadius) {
+  SoundFile& file = TrackTable::get(id);
+  // Use the nearest pyramid level instead of stretching the row thumbnail
+  LfTexture thumbnail = file.thumbnail;
+  if(ImageScaler::nearestThumbnailLevel(thumbnailContainerSize.x) != ThumbnailLevel::Row && file.gridThumbnail.width != 0) {
+    thumbnail = file.gridThumbnail;
+  }
+  bool renderPlaceholder = thumbnail.width == 0 && file.placeholder.valid;
+  if(thumbnail.width == 0) {
+    thumbnail = state.icons["music_note"];
+  }
   float aspect = (float)thumbnail.width / (float)thumbnail.height;
   float thumbnailHeight = thumbnailContainerSize.y / aspect; 
   LfUIElementProps props = lf_get_theme().button_props;
@@ -3389,12 +3482,9 @@ LfClickableItemState renderSoundFileThumbnail(vec2s thumbnailContainerSize, Soun
   props.margin_bottom = 0.0f;
   lf_push_style_props(props);
   LfClickableItemState thumbnailState = lf_item(thumbnailContainerSize);
-  if(thumbnailState == LF_CLICKED && state.playlistFileFutures.empty() && uiResponse) {
-    state.currentSoundFile = &file;
-    if(state.onTrackTab.trackThumbnail.width != 0) {
-      lf_free_texture(&state.onTrackTab.trackThumbnail);
-    }
-    state.onTrackTab.trackThumbnail = SoundTagParser::getSoundThubmnail(state.currentSoundFile->path, (vec2s){-1, -1});
+  if(thumbnailState == LF_CLICKED && uiResponse) {
+    state.currentTrack = id;
+    loadTrackThumbnail(file.path());
     changeTabTo(GuiTab::OnTrack);
 
     if(clickCb)
@@ -3402,6 +3492,17 @@ LfClickableItemState renderSoundFileThumbnail(vec2s thumbnailContainerSize, Soun
   }
   lf_pop_style_props();
 
+  if(renderPlaceholder) {
+    vec2s cellSize = (vec2s){thumbnailContainerSize.x / THUMBNAIL_PLACEHOLDER_SIZE, thumbnailContainerSize.y / THUMBNAIL_PLACEHOLDER_SIZE};
+    vec2s pos = (vec2s){lf_get_ptr_x() - thumbnailContainerSize.x, lf_get_ptr_y()};
+    for(uint32_t i = 0; i < THUMBNAIL_PLACEHOLDER_SIZE * THUMBNAIL_PLACEHOLDER_SIZE; i++) {
+      const uint8_t* color = file.placeholder.colors[i];
+      lf_rect_render((vec2s){pos.x + (i % THUMBNAIL_PLACEHOLDER_SIZE) * cellSize.x, pos.y + (i / THUMBNAIL_PLACEHOLDER_SIZE) * cellSize.y},
+          cellSize, (LfColor){color[0], color[1], color[2], 255}, LF_NO_COLOR, 0.0f, 0.0f);
+    }
+    return thumbnailState;
+  }
+
   if(thumbnailHeight >= thumbnailContainerSize.y - 10) {
     thumbnailHeight = thumbnailContainerSize.y;
   }
@@ -3456,13 +3557,13 @@ bool renderMenuBarElement(const std::string& text, uint32_t iconId) {
   return onDiv && lf_mouse_button_is_released(GLFW_MOUSE_BUTTON_LEFT);
 }
 
-std::vector<SoundFile> matchSoundFiles(const std::vector<SoundFile>& files, const std::string& searchTerm) {
-  std::vector<SoundFile> matches;
+std::vector<TrackId> matchSoundFiles(const std::vector<TrackId>& tracks, const std::string& searchTerm) {
+  std::vector<TrackId> matches;
   std::string searchTermLower = LyssaUtils::toLower(std::string(searchTerm.begin(), searchTerm.end())); 
-  for (const auto& soundFile : files) {
-    std::string titleLower = LyssaUtils::toLower(soundFile.title);
+  for (TrackId id : tracks) {
+    std::string titleLower = LyssaUtils::toLower(TrackTable::get(id).title());
     if (titleLower.find(searchTermLower) != std::string::npos) {
-      matches.push_back(soundFile);
+      matches.push_back(id);
     }
   }
   return matches;
@@ -3470,11 +3571,11 @@ std::vector<SoundFile> matchSoundFiles(const std::vector<SoundFile>& files, cons
 void searchPlaylistInputInsertCb(void* inputData) {
   LfInputField* input = (LfInputField*)inputData;
   lf_input_insert_char_idx(input, lf_char_event().charcode, input->cursor_index++);
-  state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].musicFiles, state.searchPlaylistInput.buffer);
+  state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].tracks, state.searchPlaylistInput.buffer);
 }
 
 void searchPlaylistInputKeyCb(void* inputData) {
-  state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].musicFiles, state.searchPlaylistInput.buffer);
+  state.searchPlaylistResults = matchSoundFiles(state.playlists[state.currentPlaylist].tracks, state.searchPlaylistInput.buffer);
 }
 
 LfTextProps renderTextRaw(vec2s pos, const std::string& text, LfFont font, LfColor color, float wrapPoint, vec2s stopPoint, bool noRender) {
@@ -3500,7 +3601,22 @@ int main(int argc, char* argv[]) {
   if(!std::filesystem::exists(LYSSA_DIR)) { 
     std::filesystem::create_directory(LYSSA_DIR);
   }
+  // Known covers get their placeholder before their tracks are decoded
+  ThumbnailCache::preloadIndex();
   loadPlaylists();
+  if(ASYNC_PLAYLIST_LOADING && WARM_PLAYLISTS_ON_START) {
+    warmPlaylists();
+  }
+  // Only touches the store, nothing waits for it
+  ThreadPool::submit([]() { MediaStore::collectGarbage(); }, TaskPriority::Low);
+
+  // Only tracks that are new since the last start get decoded, the playlist
+  // files are read by the job
+  std::vector<std::filesystem::path> playlistDirs;
+  for(const auto& playlist : state.playlists) {
+    playlistDirs.emplace_back(playlist.path);
+  }
+  DuplicateFinder::start(playlistDirs);
 
   // Creating the popups
 
@@ -3511,6 +3627,8 @@ int main(int argc, char* argv[]) {
 
     glClear(GL_COLOR_BUFFER_BIT);
     glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+    ThumbnailCache::beginFrame(state.deltaTime);
+    Jobs::poll();
     if(ASYNC_PLAYLIST_LOADING)
       handleAsyncPlaylistLoading();
 
@@ -3518,17 +3636,25 @@ int main(int argc, char* argv[]) {
     updateSoundProgress();
     updateFullscreenTrackTab();
 
-    if(state.playlistThumbnailDownloadIndex != -1) {
-      if(LyssaUtils::getCommandOutput("pgrep yt-dlp") == "") {
-        Playlist& playlist = state.playlists[state.playlistThumbnailDownloadIndex];
-        if(playlist.thumbnail.width != 0) {
-          lf_free_texture(&playlist.thumbnail);
+    if(state.playlistThumbnailDownload != PLAYLIST_HANDLE_NONE) {
+      if(!isYtdlpRunning()) {
+        // The playlist might have been removed while the thumbnail downloaded
+        Playlist* playlist = Playlist::get(state.playlistThumbnailDownload);
+        if(playlist) {
+          if(playlist->thumbnail.width != 0) {
+            lf_free_texture(&playlist->thumbnail);
+          }
+          playlist->thumbnail = lf_load_texture_resized(playlist->thumbnailPath.string().c_str(), false, LF_TEX_FILTER_LINEAR, THUMBNAIL_CARD_SIZE, THUMBNAIL_CARD_SIZE);
         }
-        playlist.thumbnail = lf_load_texture_resized(playlist.thumbnailPath.string().c_str(), false, LF_TEX_FILTER_LINEAR, 180, 180);
-        state.playlistThumbnailDownloadIndex = -1;
+        state.playlistThumbnailDownload = PLAYLIST_HANDLE_NONE;
       }
     }
 
+    std::vector<DuplicateCluster> duplicates;
+    if(DuplicateFinder::pollFinished(duplicates) && !duplicates.empty()) {
+      state.infoCards.addCard("Found " + std::to_string(duplicates.size()) + " duplicate tracks, see ~/.lyssa/cache/duplicates.txt");
+    }
+
     // Delta-Time calculation
     float currentTime = glfwGetTime();
     state.deltaTime = currentTime - state.lastTime;
@@ -3617,5 +3743,10 @@ int main(int argc, char* argv[]) {
   if(state.playlistDownloadRunning) {
     system("pkill yt-dlp");
   }
+  DuplicateFinder::stop();
+  // Queued tasks like add batches schedule playlist writes, so they finish
+  // before the writer stops
+  ThreadPool::shutdown();
+  PlaylistFile::shutdown();
   return 0;
 } 
@@ -0,0 +1,110 @@
+#include "mediaStore.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "utils.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static bool readFileData(const std::filesystem::path& path, std::vector<char>& data) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if(!file.is_open()) return false;
+  data.resize((size_t)file.tellg());
+  file.seekg(0);
+  return (bool)file.read(data.data(), data.size());
+}
+
+// Downloaded filename -> archive entry ("<extractor> <id>"), as written by download.sh
+static std::unordered_map<std::string, std::string> loadDownloadedIds(const std::filesystem::path& folder) {
+  std::unordered_map<std::string, std::string> ids;
+  std::ifstream file(folder / "ids.txt");
+  std::string line;
+  while(std::getline(file, line)) {
+    std::istringstream iss(line);
+    std::string extractor, id, path;
+    iss >> extractor >> id;
+    iss.ignore(1);
+    std::getline(iss, path);
+    if(path.empty()) continue;
+    ids[std::filesystem::path(path).filename().string()] = LyssaUtils::toLower(extractor) + " " + id;
+  }
+  return ids;
+}
+
+namespace MediaStore {
+  std::filesystem::path getStoreDir() {
+    return LYSSA_DIR + "/store";
+  }
+
+  void ingestFolder(const std::filesystem::path& folder) {
+    std::error_code ec;
+    std::filesystem::path objectsDir = getStoreDir() / "objects";
+    std::filesystem::create_directories(objectsDir, ec);
+
+    std::unordered_map<std::string, std::string> downloadedIds = loadDownloadedIds(folder);
+    // "<extractor> <id> <hash>" per line, read by download.sh
+    std::ofstream storeIds(getStoreDir() / "ids", std::ios::app);
+
+    // Collected first, the folder gets modified while ingesting
+    std::vector<std::filesystem::path> tracks;
+    for(const auto& entry : std::filesystem::directory_iterator(folder, ec)) {
+      // A track that is linked already is an object of the store
+      if(entry.is_regular_file() && entry.path().extension() == ".mp3" && entry.hard_link_count() == 1) {
+        tracks.emplace_back(entry.path());
+      }
+    }
+
+    std::vector<char> data, objectData;
+    for(const auto& track : tracks) {
+      if(!readFileData(track, data)) {
+        LOG_ERROR("Failed to read '%s' for the media store.", track.c_str());
+        continue;
+      }
+      char hash[17];
+      snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)LyssaUtils::hashBytes(data.data(), data.size()));
+      std::filesystem::path object = objectsDir / (std::string(hash) + ".mp3");
+
+      ec.clear();
+      if(!std::filesystem::exists(object)) {
+        std::filesystem::create_hard_link(track, object, ec);
+      } else if(readFileData(object, objectData) && objectData == data) {
+        // Swapped in with a rename, so the track path never stops being valid
+        std::filesystem::path tmpPath = track.string() + ".tmp";
+        std::filesystem::create_hard_link(object, tmpPath, ec);
+        if(!ec) {
+          std::filesystem::rename(tmpPath, track, ec);
+        }
+        if(ec) {
+          std::error_code removeEc;
+          std::filesystem::remove(tmpPath, removeEc);
+        }
+      } else {
+        LOG_WARN("'%s' collides with the stored object '%s', keeping the copy.", track.c_str(), object.c_str());
+        continue;
+      }
+      if(ec) {
+        LOG_ERROR("Failed to add '%s' to the media store: %s", track.c_str(), ec.message().c_str());
+        continue;
+      }
+
+      auto it = downloadedIds.find(track.filename().string());
+      if(it != downloadedIds.end()) {
+        storeIds << it->second << " " << hash << "\n";
+      }
+    }
+  }
+
+  void collectGarbage() {
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(getStoreDir() / "objects", ec)) {
+      if(entry.is_regular_file() && entry.hard_link_count() == 1) {
+        std::error_code removeEc;
+        std::filesystem::remove(entry.path(), removeEc);
+      }
+    }
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+
+// Downloaded tracks are stored once under ~/.lyssa/store/objects, named by
+// the hash of their content. The playlist folders in downloaded_playlists
+// hold hard links to those objects, so the paths in the .metadata files stay
+// valid while a song that is part of several playlists uses its space once.
+namespace MediaStore {
+  std::filesystem::path getStoreDir();
+
+  // Moves every downloaded track of the folder into the store and links it
+  // back. The IDs written by download.sh (ids.txt) are recorded, so later
+  // downloads link stored items instead of fetching them again.
+  void ingestFolder(const std::filesystem::path& folder);
+
+  // Removes objects that no playlist folder links to anymore
+  void collectGarbage();
+}
@@ -0,0 +1,908 @@
+#include "playlistFile.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "utils.hpp"
+#include "threadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Version 1 headers end before journalSequence
+#define PLAYLIST_FILE_V1_HEADER_SIZE offsetof(PlaylistFileHeader, journalSequence)
+
+struct Journal {
+  std::mutex mutex;
+  std::condition_variable compacted;
+  FILE* file = NULL;
+  uint64_t nextSequence = 1;
+  uint64_t size = 0;
+  bool dirty = false, compacting = false;
+};
+
+static std::mutex journalsMutex;
+static std::unordered_map<std::string, std::unique_ptr<Journal>> journals;
+// Set by shutdown, which runs after the ThreadPool was shut down. Journals
+// that rotate afterwards keep their compacting journal, it is folded on the
+// next start.
+static std::atomic<bool> compactionsStopped{false};
+
+// Full rewrites scheduled by PlaylistFile::scheduleWrite, latest snapshot per directory
+struct PendingWrite {
+  std::filesystem::path playlistDir;
+  PlaylistInfo info;
+  std::vector<std::string> filepaths;
+  uint64_t journalSequence;
+};
+
+static struct {
+  std::thread thread;
+  std::mutex mutex;
+  // Held while writing, so readers never see a snapshot that is taken but not written
+  std::mutex writeMutex;
+  std::condition_variable wake, idle;
+  std::unordered_map<std::string, PendingWrite> pending;
+  std::chrono::steady_clock::time_point firstPending;
+  bool running = false, stop = false, flushing = false, writing = false;
+} writer;
+
+static std::filesystem::path getPlaylistFilePath(const std::filesystem::path& playlistDir) {
+  return playlistDir / PLAYLIST_FILE_NAME;
+}
+
+static std::filesystem::path getJournalPath(const std::filesystem::path& playlistDir) {
+  return playlistDir / PLAYLIST_JOURNAL_FILE_NAME;
+}
+
+static std::filesystem::path getCompactingJournalPath(const std::filesystem::path& playlistDir) {
+  return playlistDir / PLAYLIST_COMPACTING_JOURNAL_FILE_NAME;
+}
+
+static bool isValidString(const PlaylistFileString& str, uint64_t stringsSize) {
+  return (uint64_t)str.offset + str.length <= stringsSize;
+}
+
+static PlaylistFileString addString(std::string& strings, std::string_view str) {
+  PlaylistFileString ret = {(uint32_t)strings.size(), (uint32_t)str.size()};
+  strings.append(str.data(), str.size());
+  return ret;
+}
+
+static void syncFile(FILE* file) {
+  fflush(file);
+#ifndef _WIN32
+  fsync(fileno(file));
+#endif
+}
+
+// Makes a rename in the directory durable
+static void syncDirectory(const std::filesystem::path& dir) {
+#ifndef _WIN32
+  int fd = ::open(dir.c_str(), O_RDONLY);
+  if(fd != -1) {
+    fsync(fd);
+    ::close(fd);
+  }
+#endif
+}
+
+static bool readFile(const std::filesystem::path& path, std::string& data) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if(!file.is_open()) return false;
+  data.resize((size_t)file.tellg());
+  file.seekg(0);
+  return (bool)file.read(data.data(), data.size());
+}
+
+static uint64_t getRecordChecksum(const char* record, size_t size) {
+  return LyssaUtils::hashBytes(record + sizeof(uint64_t), size - sizeof(uint64_t));
+}
+
+// Calls fn for every intact record and returns the size of the intact part
+template<typename Fn>
+static size_t forEachJournalRecord(std::string_view journal, Fn fn) {
+  size_t offset = 0;
+  while(journal.size() - offset >= sizeof(PlaylistJournalRecord)) {
+    PlaylistJournalRecord record;
+    memcpy(&record, journal.data() + offset, sizeof(record));
+    size_t size = sizeof(record) + record.payloadSize;
+    if(record.payloadSize > journal.size() - offset - sizeof(record) ||
+        getRecordChecksum(journal.data() + offset, size) != record.checksum ||
+        (record.op == (uint32_t)PlaylistJournalOp::MoveFile && record.pathSize > record.payloadSize)) {
+      break;
+    }
+    fn(record, journal.substr(offset + sizeof(record), record.payloadSize));
+    offset += size;
+  }
+  return offset;
+}
+
+static void encodeJournalRecord(std::string& records, uint64_t sequence, PlaylistJournalOp op, std::string_view payload,
+    std::string_view secondPayload = "", bool after = false) {
+  PlaylistJournalRecord record{};
+  record.sequence = sequence;
+  record.op = (uint32_t)op;
+  record.payloadSize = (uint32_t)(payload.size() + secondPayload.size());
+  record.pathSize = (uint32_t)payload.size();
+  record.after = after;
+
+  size_t offset = records.size();
+  records.append((const char*)&record, sizeof(record));
+  records.append(payload.data(), payload.size());
+  records.append(secondPayload.data(), secondPayload.size());
+  record.checksum = getRecordChecksum(records.data() + offset, records.size() - offset);
+  memcpy(records.data() + offset, &record.checksum, sizeof(record.checksum));
+}
+
+static uint64_t readBaseJournalSequence(const std::filesystem::path& playlistDir) {
+  PlaylistFileHeader header{};
+  FILE* file = fopen(getPlaylistFilePath(playlistDir).c_str(), "rb");
+  if(!file) return 0;
+  size_t read = fread(&header, 1, sizeof(header), file);
+  fclose(file);
+  if(read < sizeof(header) || header.magic != PLAYLIST_FILE_MAGIC || header.version < 2) return 0;
+  return header.journalSequence;
+}
+
+static bool writePlaylistFile(const std::filesystem::path& path, const PlaylistInfo& info,
+    const std::vector<std::string_view>& filepaths, uint64_t journalSequence) {
+  std::string strings;
+  PlaylistFileHeader header{};
+  header.magic = PLAYLIST_FILE_MAGIC;
+  header.version = PLAYLIST_FILE_VERSION;
+  header.entryCount = (uint32_t)filepaths.size();
+  header.entrySize = sizeof(PlaylistFileEntry);
+  header.name = addString(strings, info.name);
+  header.desc = addString(strings, info.desc);
+  header.url = addString(strings, info.url);
+  header.thumbnailPath = addString(strings, info.thumbnailPath);
+  header.journalSequence = journalSequence;
+
+  std::vector<PlaylistFileEntry> entries(filepaths.size());
+  for(size_t i = 0; i < filepaths.size(); i++) {
+    entries[i].path = addString(strings, filepaths[i]);
+  }
+  header.entriesOffset = (sizeof(header) + 7) & ~(uint64_t)7;
+  header.stringsOffset = header.entriesOffset + entries.size() * sizeof(PlaylistFileEntry);
+  header.stringsSize = strings.size();
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if(!file) return false;
+  const char padding[8] = {0};
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(padding, 1, header.entriesOffset - sizeof(header), file) == header.entriesOffset - sizeof(header) &&
+    fwrite(entries.data(), sizeof(PlaylistFileEntry), entries.size(), file) == entries.size() &&
+    fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+  if(written) {
+    syncFile(file);
+  }
+  return (fclose(file) == 0) && written;
+}
+
+static void compactJournal(std::filesystem::path playlistDir, Journal* journal) {
+  std::filesystem::path path = getPlaylistFilePath(playlistDir);
+  std::filesystem::path tmpPath = path.string() + ".tmp";
+
+  // Only the compactor touches the playlist file and the compacting journal
+  // while it runs, so both are folded without holding the journal lock
+  PlaylistFile::View view;
+  bool written = false;
+  if(view.openForCompaction(playlistDir)) {
+    PlaylistInfo info = {
+      std::string(view.getName()), std::string(view.getDesc()),
+      std::string(view.getUrl()), std::string(view.getThumbnailPath())
+    };
+    std::vector<std::string_view> paths;
+    paths.reserve(view.getFileCount());
+    for(uint32_t i = 0; i < view.getFileCount(); i++) {
+      paths.emplace_back(view.getFilepath(i));
+    }
+    written = writePlaylistFile(tmpPath, info, paths, view.getJournalSequence());
+  }
+
+  std::lock_guard<std::mutex> lock(journal->mutex);
+  std::error_code ec;
+  if(written) {
+    std::filesystem::rename(tmpPath, path, ec);
+  }
+  if(!written || ec) {
+    // The compacting journal is kept and folded again on the next start
+    LOG_ERROR("Failed to compact the journal of playlist '%s'.", playlistDir.string().c_str());
+    std::filesystem::remove(tmpPath, ec);
+  } else {
+    syncDirectory(playlistDir);
+    std::filesystem::remove(getCompactingJournalPath(playlistDir), ec);
+  }
+  journal->compacting = false;
+  journal->compacted.notify_all();
+}
+
+static void startCompaction(const std::filesystem::path& playlistDir, Journal& journal) {
+  if(compactionsStopped) return;
+  journal.compacting = true;
+  ThreadPool::submit([playlistDir, &journal]() { compactJournal(playlistDir, &journal); }, TaskPriority::Low);
+}
+
+// Journal lock has to be held. New records go to a fresh journal while the
+// full one is folded into the playlist file.
+static void rotateJournal(const std::filesystem::path& playlistDir, Journal& journal) {
+  if(journal.file) {
+    syncFile(journal.file);
+    fclose(journal.file);
+    journal.file = NULL;
+  }
+  journal.dirty = false;
+  std::error_code ec;
+  // A compacting journal that failed to fold is retried before it could be overwritten
+  if(std::filesystem::exists(getCompactingJournalPath(playlistDir), ec)) {
+    startCompaction(playlistDir, journal);
+    return;
+  }
+  std::filesystem::rename(getJournalPath(playlistDir), getCompactingJournalPath(playlistDir), ec);
+  if(ec) {
+    LOG_ERROR("Failed to rotate the journal of playlist '%s'.", playlistDir.string().c_str());
+    return;
+  }
+  journal.size = 0;
+  startCompaction(playlistDir, journal);
+}
+
+static void initJournal(const std::filesystem::path& playlistDir, Journal& journal) {
+  uint64_t sequence = readBaseJournalSequence(playlistDir);
+  auto maxSequence = [&](const PlaylistJournalRecord& record, std::string_view) {
+    sequence = std::max(sequence, record.sequence);
+  };
+
+  std::string data;
+  std::filesystem::path compactingPath = getCompactingJournalPath(playlistDir);
+  bool compactingLeft = readFile(compactingPath, data);
+  if(compactingLeft) {
+    forEachJournalRecord(data, maxSequence);
+  }
+
+  // A torn tail is cut off, otherwise it would hide the records appended after it
+  std::filesystem::path journalPath = getJournalPath(playlistDir);
+  if(readFile(journalPath, data)) {
+    size_t validSize = forEachJournalRecord(data, maxSequence);
+    if(validSize != data.size()) {
+      LOG_WARN("Dropping %i bytes of a torn record from the journal of playlist '%s'.",
+          (int32_t)(data.size() - validSize), playlistDir.string().c_str());
+      std::error_code ec;
+      std::filesystem::resize_file(journalPath, validSize, ec);
+    }
+    journal.size = validSize;
+  }
+  journal.nextSequence = sequence + 1;
+
+  // Left over from a compaction that did not finish
+  if(compactingLeft) {
+    startCompaction(playlistDir, journal);
+  }
+}
+
+static void startWriter();
+
+static Journal& getJournal(const std::filesystem::path& playlistDir) {
+  std::lock_guard<std::mutex> lock(journalsMutex);
+  std::unique_ptr<Journal>& journal = journals[playlistDir.lexically_normal().string()];
+  if(!journal) {
+    journal = std::make_unique<Journal>();
+    initJournal(playlistDir, *journal);
+  }
+  return *journal;
+}
+
+// Journal lock has to be held
+static bool writeJournalRecords(const std::filesystem::path& playlistDir, Journal& journal, const std::string& records) {
+  if(!journal.file) {
+    journal.file = fopen(getJournalPath(playlistDir).c_str(), "ab");
+    if(!journal.file) {
+      LOG_ERROR("Failed to open the journal of playlist '%s'.", playlistDir.string().c_str());
+      return false;
+    }
+  }
+  // Flushed so other views see the records, fsynced later in batches
+  if(fwrite(records.data(), 1, records.size(), journal.file) != records.size() || fflush(journal.file) != 0) {
+    LOG_ERROR("Failed to write to the journal of playlist '%s'.", playlistDir.string().c_str());
+    return false;
+  }
+  journal.dirty = true;
+  journal.size += records.size();
+  // Syncs the journal in the background
+  startWriter();
+  if(journal.size >= PLAYLIST_JOURNAL_COMPACT_SIZE && !journal.compacting) {
+    rotateJournal(playlistDir, journal);
+  }
+  return true;
+}
+
+static bool appendJournalRecord(const std::filesystem::path& playlistDir, PlaylistJournalOp op, std::string_view payload,
+    std::string_view secondPayload = "", bool after = false) {
+  Journal& journal = getJournal(playlistDir);
+  std::lock_guard<std::mutex> lock(journal.mutex);
+  std::string records;
+  encodeJournalRecord(records, journal.nextSequence++, op, payload, secondPayload, after);
+  return writeJournalRecords(playlistDir, journal, records);
+}
+
+// journalSequence is the last journal record contained in the snapshot, NULL
+// if it contains all of them. The writer's writeMutex has to be held.
+static bool writePlaylist(const std::filesystem::path& playlistDir, const PlaylistInfo& info,
+    const std::vector<std::string_view>& filepaths, const uint64_t* journalSequence) {
+  Journal& journal = getJournal(playlistDir);
+  std::unique_lock<std::mutex> lock(journal.mutex);
+  journal.compacted.wait(lock, [&]{ return !journal.compacting; });
+  uint64_t lastSequence = journal.nextSequence - 1;
+  uint64_t sequence = journalSequence ? *journalSequence : lastSequence;
+
+  std::filesystem::path path = getPlaylistFilePath(playlistDir);
+  std::filesystem::path tmpPath = path.string() + ".tmp";
+  bool written = writePlaylistFile(tmpPath, info, filepaths, sequence);
+
+  std::error_code ec;
+  if(written) {
+    std::filesystem::rename(tmpPath, path, ec);
+  }
+  if(!written || ec) {
+    LOG_ERROR("Failed to write playlist file '%s'.", path.c_str());
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+  syncDirectory(playlistDir);
+
+  // Everything that was journaled is superseded by the new file, newer
+  // records are kept and replayed on top of it
+  if(sequence == lastSequence) {
+    if(journal.file) {
+      fclose(journal.file);
+      journal.file = NULL;
+    }
+    std::filesystem::remove(getJournalPath(playlistDir), ec);
+    std::filesystem::remove(getCompactingJournalPath(playlistDir), ec);
+    journal.size = 0;
+    journal.dirty = false;
+  }
+  return true;
+}
+
+static bool writePendingWrite(const PendingWrite& pending) {
+  return writePlaylist(pending.playlistDir, pending.info,
+      std::vector<std::string_view>(pending.filepaths.begin(), pending.filepaths.end()), &pending.journalSequence);
+}
+
+// The writer's writeMutex has to be held
+static void writePending(const std::filesystem::path& playlistDir) {
+  PendingWrite pending;
+  {
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    auto it = writer.pending.find(playlistDir.lexically_normal().string());
+    if(it == writer.pending.end()) return;
+    pending = std::move(it->second);
+    writer.pending.erase(it);
+    if(writer.pending.empty()) {
+      writer.idle.notify_all();
+    }
+  }
+  writePendingWrite(pending);
+}
+
+static void runWriter() {
+  std::unique_lock<std::mutex> lock(writer.mutex);
+  while(true) {
+    // Edits within the window are coalesced into one write per playlist
+    if(writer.pending.empty()) {
+      writer.wake.wait_for(lock, std::chrono::duration<float>(PLAYLIST_JOURNAL_SYNC_INTERVAL),
+          []{ return writer.stop || !writer.pending.empty(); });
+    } else if(!writer.stop && !writer.flushing) {
+      writer.wake.wait_until(lock, writer.firstPending + std::chrono::duration<float>(PLAYLIST_WRITE_DELAY),
+          []{ return writer.stop || writer.flushing; });
+    }
+    bool stop = writer.stop;
+    bool due = !writer.pending.empty() && (stop || writer.flushing ||
+        std::chrono::steady_clock::now() >= writer.firstPending + std::chrono::duration<float>(PLAYLIST_WRITE_DELAY));
+
+    if(due) {
+      writer.writing = true;
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> writeLock(writer.writeMutex);
+        std::unordered_map<std::string, PendingWrite> pending;
+        {
+          std::lock_guard<std::mutex> pendingLock(writer.mutex);
+          pending.swap(writer.pending);
+        }
+        for(const auto& [dir, write] : pending) {
+          writePendingWrite(write);
+        }
+      }
+      lock.lock();
+      writer.writing = false;
+      writer.idle.notify_all();
+    }
+
+    // Journal records are fsynced in batches on the same thread
+    lock.unlock();
+    PlaylistFile::syncJournals();
+    lock.lock();
+    if(stop && writer.pending.empty()) break;
+  }
+  writer.running = false;
+}
+
+// File list of a journal replay. Paths are found through an index instead of
+// a scan, and moves splice nodes, so a replay is linear in its records. A
+// path that is listed more than once is found by a scan, like before.
+class ReplayList {
+  public:
+    typedef std::list<std::string_view>::iterator Iterator;
+
+    Iterator begin() { return _files.begin(); }
+    Iterator end() { return _files.end(); }
+    size_t size() const { return _files.size(); }
+
+    // First occurrence of the path
+    Iterator find(std::string_view path) {
+      auto count = _counts.find(path);
+      if(count == _counts.end()) return _files.end();
+      if(count->second == 1) return _positions[path];
+      return std::find(_files.begin(), _files.end(), path);
+    }
+
+    void insert(Iterator pos, std::string_view path) {
+      Iterator it = _files.insert(pos, path);
+      if(++_counts[path] == 1) _positions[path] = it;
+    }
+
+    void erase(Iterator it) {
+      std::string_view path = *it;
+      _files.erase(it);
+      uint32_t& count = _counts[path];
+      if(--count == 0) {
+        _counts.erase(path);
+        _positions.erase(path);
+      } else if(count == 1) {
+        _positions[path] = std::find(_files.begin(), _files.end(), path);
+      }
+    }
+
+  private:
+    std::list<std::string_view> _files;
+    std::unordered_map<std::string_view, uint32_t> _counts;
+    // Only kept for paths that are listed once
+    std::unordered_map<std::string_view, Iterator> _positions;
+};
+
+static void startWriter() {
+  std::lock_guard<std::mutex> lock(writer.mutex);
+  if(writer.running || writer.stop) return;
+  writer.running = true;
+  writer.thread = std::thread(runWriter);
+}
+
+namespace PlaylistFile {
+  View::~View() {
+    close();
+  }
+
+  bool View::open(const std::filesystem::path& playlistDir) {
+    // A scheduled rewrite of this playlist is done first, so the view is never older than the last edit
+    std::lock_guard<std::mutex> writeLock(writer.writeMutex);
+    writePending(playlistDir);
+
+    // Held so a compaction cannot swap the files in the middle of reading them
+    Journal& journal = getJournal(playlistDir);
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    return openFiles(playlistDir, true);
+  }
+
+  bool View::openForCompaction(const std::filesystem::path& playlistDir) {
+    return openFiles(playlistDir, false);
+  }
+
+  bool View::openFiles(const std::filesystem::path& playlistDir, bool activeJournal) {
+    close();
+    std::filesystem::path path = getPlaylistFilePath(playlistDir);
+    if(!mapFile(path)) return false;
+
+    // Validated once, so the accessors do not need to check bounds
+    const PlaylistFileHeader* header = (const PlaylistFileHeader*)_data;
+    size_t headerSize = header->version == 1 ? PLAYLIST_FILE_V1_HEADER_SIZE : sizeof(PlaylistFileHeader);
+    bool valid = header->magic == PLAYLIST_FILE_MAGIC && header->version >= 1 && header->version <= PLAYLIST_FILE_VERSION &&
+      _size >= headerSize && header->entriesOffset >= headerSize &&
+      header->entrySize >= sizeof(PlaylistFileEntry) && header->entriesOffset % 8 == 0 &&
+      header->entriesOffset + (uint64_t)header->entryCount * header->entrySize <= _size &&
+      header->stringsOffset + header->stringsSize <= _size &&
+      isValidString(header->name, header->stringsSize) && isValidString(header->desc, header->stringsSize) &&
+      isValidString(header->url, header->stringsSize) && isValidString(header->thumbnailPath, header->stringsSize);
+    for(uint32_t i = 0; valid && i < header->entryCount; i++) {
+      const PlaylistFileEntry* entry = (const PlaylistFileEntry*)(_data + header->entriesOffset + (size_t)i * header->entrySize);
+      valid = isValidString(entry->path, header->stringsSize);
+    }
+    if(!valid) {
+      LOG_ERROR("Playlist file '%s' is corrupted or has an unsupported version.", path.c_str());
+      close();
+      return false;
+    }
+
+    _name = getString(header->name);
+    _desc = getString(header->desc);
+    _url = getString(header->url);
+    _thumbnailPath = getString(header->thumbnailPath);
+    _journalSequence = header->version >= 2 ? header->journalSequence : 0;
+
+    // Both journals are kept in one buffer, the replayed views point into it
+    std::string journal;
+    if(readFile(getCompactingJournalPath(playlistDir), journal)) {
+      _journal = journal;
+    }
+    if(activeJournal && readFile(getJournalPath(playlistDir), journal)) {
+      _journal += journal;
+    }
+    if(!_journal.empty()) {
+      replayJournal(_journal);
+    }
+    return true;
+  }
+
+  bool View::mapFile(const std::filesystem::path& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1) return false;
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size < (off_t)PLAYLIST_FILE_V1_HEADER_SIZE) {
+      ::close(fd);
+      return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) return false;
+    _data = (const unsigned char*)data;
+    _size = (size_t)st.st_size;
+    _mapped = true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file.is_open()) return false;
+    _buffer.resize((size_t)file.tellg());
+    file.seekg(0);
+    if(_buffer.size() < PLAYLIST_FILE_V1_HEADER_SIZE || !file.read((char*)_buffer.data(), _buffer.size())) {
+      _buffer.clear();
+      return false;
+    }
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+    return true;
+  }
+
+  void View::replayJournal(std::string_view journal) {
+    ReplayList files;
+    forEachJournalRecord(journal, [&](const PlaylistJournalRecord& record, std::string_view payload) {
+      // Records up to the sequence of the file were compacted into it already
+      if(record.sequence <= _journalSequence) return;
+      _journalSequence = record.sequence;
+
+      PlaylistJournalOp op = (PlaylistJournalOp)record.op;
+      if(!_journaled && (op == PlaylistJournalOp::AddFile || op == PlaylistJournalOp::RemoveFile || op == PlaylistJournalOp::MoveFile)) {
+        for(uint32_t i = 0; i < getFileCount(); i++) {
+          files.insert(files.end(), getFilepath(i));
+        }
+        _journaled = true;
+      }
+      switch(op) {
+        case PlaylistJournalOp::AddFile:
+          files.insert(files.end(), payload);
+          break;
+        case PlaylistJournalOp::RemoveFile: {
+          auto it = files.find(payload);
+          if(it != files.end()) files.erase(it);
+          break;
+        }
+        case PlaylistJournalOp::MoveFile: {
+          std::string_view path = payload.substr(0, record.pathSize), anchor = payload.substr(record.pathSize);
+          auto it = files.find(path);
+          if(it == files.end() || files.find(anchor) == files.end()) break;
+          files.erase(it);
+          auto anchorIt = files.find(anchor);
+          files.insert(record.after && anchorIt != files.end() ? std::next(anchorIt) : anchorIt, path);
+          break;
+        }
+        case PlaylistJournalOp::SetName:
+          _name = payload;
+          break;
+        case PlaylistJournalOp::SetDesc:
+          _desc = payload;
+          break;
+        case PlaylistJournalOp::SetThumbnailPath:
+          _thumbnailPath = payload;
+          break;
+        default:
+          break;
+      }
+    });
+    if(_journaled) {
+      _files.assign(files.begin(), files.end());
+    }
+  }
+
+  void View::close() {
+#ifndef _WIN32
+    if(_mapped) {
+      munmap((void*)_data, _size);
+    }
+#endif
+    _buffer.clear();
+    _data = NULL;
+    _size = 0;
+    _mapped = false;
+    _name = _desc = _url = _thumbnailPath = "";
+    _journalSequence = 0;
+    _journaled = false;
+    _files.clear();
+    _journal.clear();
+  }
+
+  std::string_view View::getString(const PlaylistFileString& str) const {
+    const PlaylistFileHeader* header = (const PlaylistFileHeader*)_data;
+    return std::string_view((const char*)_data + header->stringsOffset + str.offset, str.length);
+  }
+
+  std::string_view View::getName() const {
+    return _name;
+  }
+
+  std::string_view View::getDesc() const {
+    return _desc;
+  }
+
+  std::string_view View::getUrl() const {
+    return _url;
+  }
+
+  std::string_view View::getThumbnailPath() const {
+    return _thumbnailPath;
+  }
+
+  uint32_t View::getFileCount() const {
+    if(_journaled) return (uint32_t)_files.size();
+    if(!_data) return 0;
+    return ((const PlaylistFileHeader*)_data)->entryCount;
+  }
+
+  std::string_view View::getFilepath(uint32_t i) const {
+    if(_journaled) return _files[i];
+    const PlaylistFileHeader* header = (const PlaylistFileHeader*)_data;
+    const PlaylistFileEntry* entry = (const PlaylistFileEntry*)(_data + header->entriesOffset + (size_t)i * header->entrySize);
+    return getString(entry->path);
+  }
+
+  bool View::containsFile(std::string_view path) const {
+    for(uint32_t i = 0; i < getFileCount(); i++) {
+      if(getFilepath(i) == path) return true;
+    }
+    return false;
+  }
+
+  uint64_t View::getJournalSequence() const {
+    return _journalSequence;
+  }
+
+  bool write(const std::filesystem::path& playlistDir, const PlaylistInfo& info, const std::vector<std::string_view>& filepaths) {
+    std::lock_guard<std::mutex> lock(writer.writeMutex);
+    return writePlaylist(playlistDir, info, filepaths, NULL);
+  }
+
+  void scheduleWrite(const std::filesystem::path& playlistDir, const PlaylistInfo& info, const std::vector<std::string>& filepaths) {
+    startWriter();
+    // Taken now, records that are journaled after the snapshot still apply on top of it
+    uint64_t journalSequence;
+    {
+      Journal& journal = getJournal(playlistDir);
+      std::lock_guard<std::mutex> lock(journal.mutex);
+      journalSequence = journal.nextSequence - 1;
+    }
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    if(writer.pending.empty()) {
+      writer.firstPending = std::chrono::steady_clock::now();
+    }
+    writer.pending[playlistDir.lexically_normal().string()] = {playlistDir, info, filepaths, journalSequence};
+    writer.wake.notify_all();
+  }
+
+  void flush() {
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    if(!writer.running) return;
+    writer.flushing = true;
+    writer.wake.notify_all();
+    writer.idle.wait(lock, []{ return writer.pending.empty() && !writer.writing; });
+    writer.flushing = false;
+  }
+
+  bool readInfo(const std::filesystem::path& playlistDir, PlaylistInfo& info) {
+    std::lock_guard<std::mutex> writeLock(writer.writeMutex);
+    writePending(playlistDir);
+
+    Journal& journal = getJournal(playlistDir);
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    std::filesystem::path path = getPlaylistFilePath(playlistDir);
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    // Only the header and the info strings at the start of the string table
+    // are read, the entries are never touched
+    PlaylistFileHeader header{};
+    size_t headerSize = fread(&header, 1, sizeof(header), file);
+    const PlaylistFileString* strings[] = {&header.name, &header.desc, &header.url, &header.thumbnailPath};
+    bool valid = headerSize >= PLAYLIST_FILE_V1_HEADER_SIZE && header.magic == PLAYLIST_FILE_MAGIC &&
+      header.version >= 1 && header.version <= PLAYLIST_FILE_VERSION &&
+      (header.version == 1 || headerSize == sizeof(header));
+    uint64_t begin = UINT64_MAX, end = 0;
+    for(const PlaylistFileString* str : strings) {
+      valid = valid && isValidString(*str, header.stringsSize);
+      begin = std::min<uint64_t>(begin, str->offset);
+      end = std::max<uint64_t>(end, (uint64_t)str->offset + str->length);
+    }
+    std::string data(valid ? end - begin : 0, '\0');
+    valid = valid && fseek(file, (long)(header.stringsOffset + begin), SEEK_SET) == 0 &&
+      fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    if(!valid) {
+      LOG_ERROR("Playlist file '%s' is corrupted or has an unsupported version.", path.c_str());
+      return false;
+    }
+    std::string* values[] = {&info.name, &info.desc, &info.url, &info.thumbnailPath};
+    for(size_t i = 0; i < 4; i++) {
+      values[i]->assign(data, strings[i]->offset - begin, strings[i]->length);
+    }
+
+    // The journals are bounded by the compaction size, only the info records apply
+    uint64_t baseSequence = header.version >= 2 ? header.journalSequence : 0;
+    auto applyRecord = [&](const PlaylistJournalRecord& record, std::string_view payload) {
+      if(record.sequence <= baseSequence) return;
+      switch((PlaylistJournalOp)record.op) {
+        case PlaylistJournalOp::SetName: info.name = payload; break;
+        case PlaylistJournalOp::SetDesc: info.desc = payload; break;
+        case PlaylistJournalOp::SetThumbnailPath: info.thumbnailPath = payload; break;
+        default: break;
+      }
+    };
+    std::string journalData;
+    if(readFile(getCompactingJournalPath(playlistDir), journalData)) {
+      forEachJournalRecord(journalData, applyRecord);
+    }
+    if(readFile(getJournalPath(playlistDir), journalData)) {
+      forEachJournalRecord(journalData, applyRecord);
+    }
+    return true;
+  }
+
+  bool appendFiles(const std::filesystem::path& playlistDir, const std::vector<std::string>& filepaths) {
+    Journal& journal = getJournal(playlistDir);
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    std::string records;
+    for(const auto& path : filepaths) {
+      encodeJournalRecord(records, journal.nextSequence++, PlaylistJournalOp::AddFile, path);
+    }
+    return writeJournalRecords(playlistDir, journal, records);
+  }
+
+  bool removeFile(const std::filesystem::path& playlistDir, std::string_view path) {
+    return appendJournalRecord(playlistDir, PlaylistJournalOp::RemoveFile, path);
+  }
+
+  bool moveFile(const std::filesystem::path& playlistDir, std::string_view path, std::string_view anchor, bool after) {
+    return appendJournalRecord(playlistDir, PlaylistJournalOp::MoveFile, path, anchor, after);
+  }
+
+  bool setName(const std::filesystem::path& playlistDir, std::string_view name) {
+    return appendJournalRecord(playlistDir, PlaylistJournalOp::SetName, name);
+  }
+
+  bool setDesc(const std::filesystem::path& playlistDir, std::string_view desc) {
+    return appendJournalRecord(playlistDir, PlaylistJournalOp::SetDesc, desc);
+  }
+
+  bool setThumbnailPath(const std::filesystem::path& playlistDir, std::string_view thumbnailPath) {
+    return appendJournalRecord(playlistDir, PlaylistJournalOp::SetThumbnailPath, thumbnailPath);
+  }
+
+  void syncJournals() {
+    std::lock_guard<std::mutex> lock(journalsMutex);
+    for(auto& [dir, journal] : journals) {
+      std::lock_guard<std::mutex> journalLock(journal->mutex);
+      if(journal->dirty && journal->file) {
+        syncFile(journal->file);
+      }
+      journal->dirty = false;
+    }
+  }
+
+  void shutdown() {
+    compactionsStopped = true;
+    {
+      std::unique_lock<std::mutex> lock(writer.mutex);
+      writer.stop = true;
+      writer.wake.notify_all();
+    }
+    if(writer.thread.joinable()) {
+      writer.thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(journalsMutex);
+    for(auto& [dir, journal] : journals) {
+      std::unique_lock<std::mutex> journalLock(journal->mutex);
+      journal->compacted.wait(journalLock, [&]{ return !journal->compacting; });
+      if(journal->file) {
+        syncFile(journal->file);
+        fclose(journal->file);
+        journal->file = NULL;
+      }
+      journal->dirty = false;
+    }
+  }
+
+  bool migrate(const std::filesystem::path& playlistDir) {
+    std::filesystem::path legacyPath = playlistDir / PLAYLIST_LEGACY_FILE_NAME;
+    if(std::filesystem::exists(getPlaylistFilePath(playlistDir)) || !std::filesystem::exists(legacyPath)) {
+      return true;
+    }
+
+    std::ifstream metadata(legacyPath);
+    if(!metadata.is_open()) {
+      LOG_ERROR("Failed to open the metadata of playlist on path '%s'\n", playlistDir.string().c_str());
+      return false;
+    }
+
+    // "key: value" lines, the paths are quoted on the files: line
+    PlaylistInfo info;
+    std::vector<std::string> filepaths;
+    std::string line;
+    while(std::getline(metadata, line)) {
+      std::istringstream iss(line);
+      std::string key, value;
+      iss >> key;
+
+      if(key == "files:") {
+        std::string path;
+        while(iss >> std::quoted(path)) {
+          filepaths.emplace_back(path);
+        }
+        continue;
+      }
+      std::getline(iss, value);
+      value.erase(0, value.find_first_not_of(" \t"));
+      value.erase(value.find_last_not_of(" \t") + 1);
+      if(key == "name:") info.name = value;
+      else if(key == "desc:") info.desc = value;
+      else if(key == "url:") info.url = value;
+      else if(key == "thumbnail:") info.thumbnailPath = value;
+    }
+    metadata.close();
+
+    if(!write(playlistDir, info, std::vector<std::string_view>(filepaths.begin(), filepaths.end()))) {
+      return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(legacyPath, legacyPath.string() + ".bak", ec);
+    LOG_INFO("Migrated playlist '%s' (%i files).", playlistDir.string().c_str(), (int32_t)filepaths.size());
+    return true;
+  }
+}
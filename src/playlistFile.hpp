@@ -0,0 +1,153 @@
+#pragma once
+
+#include <filesystem>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define PLAYLIST_FILE_NAME ".playlist"
+#define PLAYLIST_LEGACY_FILE_NAME ".metadata"
+#define PLAYLIST_JOURNAL_FILE_NAME ".playlist.journal"
+#define PLAYLIST_COMPACTING_JOURNAL_FILE_NAME ".playlist.journal.compacting"
+
+#define PLAYLIST_FILE_MAGIC 0x4c50594c // "LYPL"
+#define PLAYLIST_FILE_VERSION 2
+
+// On-disk layout of a playlist (little endian):
+//   PlaylistFileHeader
+//   PlaylistFileEntry[entryCount]  (entrySize bytes each, 8 byte aligned)
+//   string table                   (UTF-8, not NUL terminated)
+// Every string is referenced by its offset into the string table, so the file
+// is used directly from the mapping without copying a single path.
+struct PlaylistFileString {
+  uint32_t offset, length;
+};
+
+struct PlaylistFileHeader {
+  uint32_t magic, version;
+  uint32_t entryCount;
+  // Readers step by entrySize, so newer versions can append fields
+  uint32_t entrySize;
+  uint64_t entriesOffset;
+  uint64_t stringsOffset, stringsSize;
+  PlaylistFileString name, desc, url, thumbnailPath;
+  // Version 2: journal records up to this sequence are part of the file
+  uint64_t journalSequence;
+};
+
+struct PlaylistFileEntry {
+  PlaylistFileString path;
+};
+
+// Edits are appended to the journal of the playlist instead of rewriting the
+// file. Each record is followed by payloadSize bytes of payload (a path or
+// the new value) and a record that fails the checksum ends the journal, so a
+// record that was torn by a crash is dropped.
+enum class PlaylistJournalOp : uint32_t {
+  AddFile = 1,
+  RemoveFile,
+  // Payload is the moved path followed by the path it is moved next to
+  MoveFile,
+  SetName,
+  SetDesc,
+  SetThumbnailPath,
+};
+
+struct PlaylistJournalRecord {
+  uint64_t checksum;
+  uint64_t sequence;
+  uint32_t op;
+  uint32_t payloadSize;
+  // MoveFile only
+  uint32_t pathSize, after;
+};
+
+struct PlaylistInfo {
+  std::string name, desc, url, thumbnailPath;
+};
+
+namespace PlaylistFile {
+  // Read-only, memory mapped view of a playlist file. Opening validates the
+  // whole file once, the accessors are O(1) and return views into the mapping.
+  // Journal records that are not compacted yet are replayed on open.
+  class View {
+    public:
+      View() = default;
+      ~View();
+      View(const View&) = delete;
+      View& operator=(const View&) = delete;
+
+      bool open(const std::filesystem::path& playlistDir);
+      // Skips the active journal, only used by the compactor
+      bool openForCompaction(const std::filesystem::path& playlistDir);
+      void close();
+
+      std::string_view getName() const;
+      std::string_view getDesc() const;
+      std::string_view getUrl() const;
+      std::string_view getThumbnailPath() const;
+
+      uint32_t getFileCount() const;
+      std::string_view getFilepath(uint32_t i) const;
+      bool containsFile(std::string_view path) const;
+
+      // Sequence of the last journal record that is part of the view
+      uint64_t getJournalSequence() const;
+
+    private:
+      bool openFiles(const std::filesystem::path& playlistDir, bool activeJournal);
+      bool mapFile(const std::filesystem::path& path);
+      void replayJournal(std::string_view journal);
+      std::string_view getString(const PlaylistFileString& str) const;
+
+      const unsigned char* _data = NULL;
+      size_t _size = 0;
+      bool _mapped = false;
+      std::vector<unsigned char> _buffer;
+
+      std::string_view _name, _desc, _url, _thumbnailPath;
+      uint64_t _journalSequence = 0;
+      // Replayed file list, only used when the journal changed the files
+      bool _journaled = false;
+      std::vector<std::string_view> _files;
+      std::string _journal;
+  };
+
+  // Reads only the header and the info strings, and the info records of the
+  // journal. Cheap no matter how many files the playlist has.
+  bool readInfo(const std::filesystem::path& playlistDir, PlaylistInfo& info);
+
+  // Writes the playlist to a temporary file, fsyncs it and renames it over
+  // the old one. The journal is cleared, the new file contains all of its edits.
+  bool write(const std::filesystem::path& playlistDir, const PlaylistInfo& info, const std::vector<std::string_view>& filepaths);
+
+  // Hands a snapshot of the playlist to the writer thread. Snapshots of the
+  // same playlist within PLAYLIST_WRITE_DELAY are coalesced into one write.
+  // Opening a view of the playlist writes a pending snapshot first.
+  void scheduleWrite(const std::filesystem::path& playlistDir, const PlaylistInfo& info, const std::vector<std::string>& filepaths);
+  // Blocks until every scheduled write is on disk
+  void flush();
+
+  // Journaled edits, each costs one small append no matter the playlist size
+  bool appendFiles(const std::filesystem::path& playlistDir, const std::vector<std::string>& filepaths);
+  bool removeFile(const std::filesystem::path& playlistDir, std::string_view path);
+  // Places path before the anchor, or behind it if after is set
+  bool moveFile(const std::filesystem::path& playlistDir, std::string_view path, std::string_view anchor, bool after);
+  bool setName(const std::filesystem::path& playlistDir, std::string_view name);
+  bool setDesc(const std::filesystem::path& playlistDir, std::string_view desc);
+  bool setThumbnailPath(const std::filesystem::path& playlistDir, std::string_view thumbnailPath);
+
+  // Records are flushed to the OS right away but only fsynced here, called
+  // every PLAYLIST_JOURNAL_SYNC_INTERVAL by the writer thread
+  void syncJournals();
+  // Flushes the scheduled writes, stops the writer thread, waits for running
+  // compactions and syncs and closes all journals. Called after
+  // ThreadPool::shutdown, so the writes of queued tasks are not lost.
+  void shutdown();
+
+  // Converts a legacy .metadata file to the current format if the playlist
+  // has not been converted yet. The legacy file is kept as .metadata.bak.
+  bool migrate(const std::filesystem::path& playlistDir);
+}
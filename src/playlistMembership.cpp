@@ -0,0 +1,138 @@
+#include "playlistMembership.hpp"
+#include "playlistFile.hpp"
+#include "jobs.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct IndexedPlaylist {
+  std::filesystem::path dir;
+  bool indexed = false, indexing = false, removed = false;
+};
+
+// Paths of the playlist file, empty if it could not be opened
+struct PlaylistFiles {
+  std::vector<std::string> paths;
+  bool opened = false;
+};
+
+static std::vector<IndexedPlaylist> playlists;
+// Sorted playlist IDs per track, most tracks are part of one or two playlists
+static std::vector<std::vector<uint32_t>> memberships;
+
+static std::vector<uint32_t>& getMemberships(TrackId track) {
+  if(track >= memberships.size()) {
+    memberships.resize(TrackTable::size());
+  }
+  return memberships[track];
+}
+
+static void insertSorted(std::vector<uint32_t>& ids, uint32_t id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if(it == ids.end() || *it != id) {
+    ids.insert(it, id);
+  }
+}
+
+static void eraseSorted(std::vector<uint32_t>& ids, uint32_t id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if(it != ids.end() && *it == id) {
+    ids.erase(it);
+  }
+}
+
+static PlaylistFiles readPlaylistFiles(const std::filesystem::path& playlistDir) {
+  PlaylistFiles files;
+  PlaylistFile::View view;
+  if(!view.open(playlistDir)) return files;
+  files.opened = true;
+  files.paths.reserve(view.getFileCount());
+  for(uint32_t i = 0; i < view.getFileCount(); i++) {
+    files.paths.emplace_back(view.getFilepath(i));
+  }
+  return files;
+}
+
+static void mergePlaylistFiles(uint32_t playlistId, const PlaylistFiles& files) {
+  IndexedPlaylist& playlist = playlists[playlistId];
+  playlist.indexed = true;
+  if(!files.opened) {
+    LOG_ERROR("Failed to index the files of playlist on path '%s'\n", playlist.dir.c_str());
+    return;
+  }
+  for(const auto& path : files.paths) {
+    TrackId track = TrackTable::intern(std::filesystem::path(path));
+    insertSorted(getMemberships(track), playlistId);
+  }
+}
+
+// Edits need the whole index, so a playlist whose job did not finish yet is
+// read right away. The result of the job is dropped then.
+static void indexPlaylist(uint32_t playlistId) {
+  IndexedPlaylist& playlist = playlists[playlistId];
+  if(playlist.indexed || playlist.removed) return;
+  mergePlaylistFiles(playlistId, readPlaylistFiles(playlist.dir));
+}
+
+namespace PlaylistMembership {
+  uint32_t registerPlaylist(const std::filesystem::path& playlistDir) {
+    uint32_t playlistId = (uint32_t)playlists.size();
+    playlists.push_back({playlistDir});
+    playlists.back().indexing = true;
+    // The file is read on the ThreadPool, only the interning runs on the UI thread
+    Jobs::submit<PlaylistFiles>([playlistDir]() { return readPlaylistFiles(playlistDir); },
+        [playlistId](PlaylistFiles& files) {
+        IndexedPlaylist& playlist = playlists[playlistId];
+        playlist.indexing = false;
+        if(playlist.indexed || playlist.removed) return;
+        mergePlaylistFiles(playlistId, files);
+        });
+    return playlistId;
+  }
+
+  void removePlaylist(uint32_t playlistId) {
+    clear(playlistId);
+    playlists[playlistId].removed = true;
+  }
+
+  void add(TrackId track, uint32_t playlistId) {
+    if(track == TRACK_ID_NONE) return;
+    indexPlaylist(playlistId);
+    insertSorted(getMemberships(track), playlistId);
+  }
+
+  void remove(TrackId track, uint32_t playlistId) {
+    indexPlaylist(playlistId);
+    if(track == TRACK_ID_NONE || track >= memberships.size()) return;
+    eraseSorted(memberships[track], playlistId);
+  }
+
+  void clear(uint32_t playlistId) {
+    for(auto& ids : memberships) {
+      eraseSorted(ids, playlistId);
+    }
+    // Edits that follow describe the whole playlist
+    playlists[playlistId].indexed = true;
+  }
+
+  Membership query(TrackId track, uint32_t playlistId) {
+    if(!playlists[playlistId].indexed) return Membership::Unknown;
+    if(track == TRACK_ID_NONE || track >= memberships.size()) return Membership::Absent;
+    const std::vector<uint32_t>& ids = memberships[track];
+    return std::binary_search(ids.begin(), ids.end(), playlistId) ? Membership::Present : Membership::Absent;
+  }
+
+  Membership query(const std::filesystem::path& path, uint32_t playlistId) {
+    // Indexing interns the files of the playlist, a path that was never
+    // interned is not part of an indexed playlist
+    if(!playlists[playlistId].indexed) return Membership::Unknown;
+    return query(TrackTable::find(path), playlistId);
+  }
+
+  bool contains(TrackId track, uint32_t playlistId) {
+    indexPlaylist(playlistId);
+    return query(track, playlistId) == Membership::Present;
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "trackTable.hpp"
+
+#include <filesystem>
+#include <stdint.h>
+
+// Index of the playlists every track is part of, so membership checks in the
+// render loop never open a playlist file. Every playlist is read by a job
+// once it is registered and kept up to date by the playlist edits afterwards.
+// Only used from the UI thread.
+enum class Membership {
+  Unknown, // The job that reads the playlist did not finish yet
+  Absent,
+  Present
+};
+
+namespace PlaylistMembership {
+  // Returns a stable ID for the playlist, indices into state.playlists shift
+  // when a playlist is removed
+  uint32_t registerPlaylist(const std::filesystem::path& playlistDir);
+  void removePlaylist(uint32_t playlistId);
+
+  void add(TrackId track, uint32_t playlistId);
+  void remove(TrackId track, uint32_t playlistId);
+  // Removes every track from the playlist
+  void clear(uint32_t playlistId);
+
+  // Only read the index, for the render loop
+  Membership query(TrackId track, uint32_t playlistId);
+  Membership query(const std::filesystem::path& path, uint32_t playlistId);
+  // Reads the playlist right away if its job did not finish, for edits
+  bool contains(TrackId track, uint32_t playlistId);
+}
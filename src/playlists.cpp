@@ -1,37 +1,71 @@
 #include "playlists.hpp"
 #include "global.hpp"
-#include "soundHandler.hpp"
 #include "soundTagParser.hpp"
+#include "imageScaler.hpp"
+#include "playlistFile.hpp"
+#include "playlistMembership.hpp"
+#include "threadPool.hpp"
 
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+
+// Handle -> index into state.playlists
+static SlotMap<uint32_t> playlistIndices;
+
+struct BatchFile {
+  TrackId id;
+  std::string path;
+};
+
+// Only validates the files and journals them, the TrackLoader loads the
+// metadata and covers once the batch is merged
+static void addFilesAsync(const std::filesystem::path& playlistDir, PlaylistLoadContext& loader, const std::vector<BatchFile>& files) {
+  // Not a vector<bool>, the workers write neighbouring elements
+  std::vector<uint8_t> valid(files.size(), 0);
+
+  std::atomic<uint32_t> next{0};
+  auto work = [&]() {
+    for(uint32_t i = next++; i < files.size(); i = next++) {
+      const BatchFile& file = files[i];
+      valid[i] = std::ifstream(file.path).good() && SoundTagParser::isValidSoundFile(file.path);
+      loader.addDone++;
+    }
+  };
+  ThreadPool::run(work);
 
-static std::string getMetadataValue(const std::filesystem::directory_entry& playlistDir, const std::string& searchKey) {
-  std::ifstream metadata(playlistDir.path().string() + "/.metadata");
-
-  if(!metadata.is_open()) {
-    LOG_ERROR("Failed to open the metadata of playlist on path '%s'\n", playlistDir.path().string().c_str());
-    return "No valid description";
+  // One journal write for the whole batch
+  std::vector<std::string> paths;
+  for(uint32_t i = 0; i < files.size(); i++) {
+    if(valid[i]) paths.emplace_back(files[i].path);
   }
+  bool appended = paths.empty() || PlaylistFile::appendFiles(playlistDir, paths);
 
-  std::string ret;
-  std::string line;
-  while(std::getline(metadata, line)) {
-    std::istringstream iss(line);
-    std::string key;
-    iss >> key;
-
-    if(key == searchKey) {
-      std::getline(iss, ret);
-      ret.erase(0, ret.find_first_not_of(" \t"));
-      ret.erase(ret.find_last_not_of(" \t") + 1);
-    }
+  std::lock_guard<std::mutex> lock(loader.mutex);
+  for(uint32_t i = 0; i < files.size(); i++) {
+    loader.addedTracks.push_back({files[i].id, valid[i] && appended});
   }
-  return ret;
+}
+
+uint32_t Playlist::add(const Playlist& playlist) {
+  uint32_t index = state.playlists.size();
+  state.playlists.emplace_back(playlist);
+  state.playlists.back().handle = playlistIndices.insert(index);
+  return index;
+}
 
+Playlist* Playlist::get(PlaylistHandle handle) {
+  uint32_t* index = playlistIndices.get(handle);
+  return index ? &state.playlists[*index] : NULL;
 }
+
+int32_t Playlist::indexOf(PlaylistHandle handle) {
+  uint32_t* index = playlistIndices.get(handle);
+  return index ? (int32_t)*index : -1;
+}
+
 FileStatus Playlist::create(const std::string& name, const std::string& desc, const std::string& url,
     const std::filesystem::path& thumbnailPath) {
   std::string nameCpy = name;
@@ -48,32 +82,42 @@ FileStatus Playlist::create(const std::string& name, const std::string& desc, co
     return FileStatus::AlreadyExists;
   }
 
-  std::ofstream metadata(folderPath + "/.metadata");
-  if(metadata.is_open()) {
-    metadata << "name: " << name << "\n";
-    metadata << "desc: " << desc << "\n";
-    metadata << "url: " << url << "\n";
-    metadata << "thumbnail: " << ((url.empty()) ? thumbnailPath.string() : std::string(folderPath + "/thumbnail.jpg.jpg")) << "\n";
-    metadata << "files: ";
-  } else {
+  PlaylistInfo info = {name, desc, url, (url.empty()) ? thumbnailPath.string() : std::string(folderPath + "/thumbnail.jpg.jpg")};
+  if(!PlaylistFile::write(folderPath, info, {})) {
     return FileStatus::Failed;
   }
-  metadata.close();
 
   return FileStatus::Success;
 }
 FileStatus Playlist::rename(const std::string& name, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
   playlist.name = name; 
-  return Playlist::save(playlistIndex);
+  if(!PlaylistFile::setName(playlist.path, name)) return FileStatus::Failed;
+  return FileStatus::Success;
 }
 FileStatus Playlist::remove(uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
 
   if(!std::filesystem::exists(playlist.path) || !std::filesystem::is_directory(playlist.path)) return FileStatus::Failed;
 
+  // A scheduled write must not recreate files in the removed folder
+  PlaylistFile::flush();
+
   std::filesystem::remove_all(playlist.path);
-  state.playlists.erase(std::find(state.playlists.begin(), state.playlists.end(), playlist));
+  PlaylistMembership::removePlaylist(playlist.id);
+  if(playlist.loader->generation != LOAD_GENERATION_NONE) {
+    TrackLoader::cancel(playlist.loader->generation);
+  }
+  playlistIndices.remove(playlist.handle);
+  state.playlists.erase(state.playlists.begin() + playlistIndex);
+  // The playlists behind it moved down by one
+  for(uint32_t i = playlistIndex; i < state.playlists.size(); i++) {
+    *playlistIndices.get(state.playlists[i].handle) = i;
+  }
+  for(int32_t* index : {&state.currentPlaylist, &state.playingPlaylist}) {
+    if(*index == (int32_t)playlistIndex) *index = -1;
+    else if(*index > (int32_t)playlistIndex) (*index)--;
+  }
 
   return FileStatus::Success;
 }
@@ -81,142 +125,104 @@ FileStatus Playlist::remove(uint32_t playlistIndex) {
 FileStatus Playlist::changeDesc(const std::string& desc, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
   playlist.desc = desc; 
-  return Playlist::save(playlistIndex);
+  if(!PlaylistFile::setDesc(playlist.path, desc)) return FileStatus::Failed;
+  return FileStatus::Success;
 }
-FileStatus changeThumbnail(const std::filesystem::path& thumbnailPath, uint32_t playlistIndex) {
+FileStatus Playlist::changeThumbnail(const std::filesystem::path& thumbnailPath, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
   playlist.thumbnailPath = thumbnailPath; 
-  return Playlist::save(playlistIndex);
+  if(!PlaylistFile::setThumbnailPath(playlist.path, thumbnailPath.string())) return FileStatus::Failed;
+  return FileStatus::Success;
 }
 
 FileStatus Playlist::save(uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
-  std::ofstream metdata(playlist.path.string() + "/.metadata", std::ios::trunc);
-
-  if(!metdata.is_open()) return FileStatus::Failed;
-
-  metdata << "name: " << playlist.name << "\n";
-  metdata << "desc: " << playlist.desc << "\n";
-  metdata << "url: " << playlist.url << "\n";
-  metdata << "thumbnail: " << playlist.thumbnailPath.string() << "\n";
-  metdata << "files: ";
-
-  for(auto& file : playlist.musicFiles) {
-    metdata << "\"" << file.path.string() << "\" ";
+  std::vector<std::string> paths;
+  paths.reserve(playlist.tracks.size());
+  for(TrackId id : playlist.tracks) {
+    paths.emplace_back(TrackTable::get(id).path().string());
   }
+  PlaylistInfo info = {playlist.name, playlist.desc, playlist.url, playlist.thumbnailPath.string()};
+  // Written by the writer thread, edits in quick succession are coalesced
+  PlaylistFile::scheduleWrite(playlist.path, info, paths);
   return FileStatus::Success;
-
 }
 FileStatus Playlist::addFile(const std::filesystem::path& path, uint32_t playlistIndex) {
-  if(Playlist::containsFile(path, playlistIndex)) return FileStatus::AlreadyExists;
-
+  return addFiles({path}, playlistIndex);
+}
+FileStatus Playlist::addFiles(const std::vector<std::filesystem::path>& paths, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
-
-  std::ofstream metadata(playlist.path.string() + "/.metadata", std::ios::app);
-
-  if(!metadata.is_open()) return FileStatus::Failed;
-
-  std::ifstream playlistFile(path);
-  if(!playlistFile.good()) return FileStatus::Failed;
-
-  metadata.seekp(0, std::ios::end);
-
-  metadata << "\"" << path.string() << "\" ";
-  metadata.close();
-
-  state.loadedPlaylistFilepaths.emplace_back(path);
-
-  playlist.musicFiles.emplace_back((SoundFile){
-      .path = path,  
-      .duration = static_cast<int32_t>(SoundHandler::getSoundDuration(path)),
-      .thumbnail = SoundTagParser::getSoundThubmnail(path, (vec2s){0.1, 0.1})
-      });
-
+  std::vector<BatchFile> files;
+  for(const auto& path : paths) {
+    TrackId id = TrackTable::intern(path);
+    // Added to the index right away, so duplicates within the batch and
+    // batches that overlap are skipped as well
+    if(PlaylistMembership::contains(id, playlist.id)) continue;
+    PlaylistMembership::add(id, playlist.id);
+    files.push_back({id, path.string()});
+  }
+  if(files.empty()) return FileStatus::AlreadyExists;
+
+  std::shared_ptr<PlaylistLoadContext> loader = playlist.loader;
+  loader->addTotal += files.size();
+  std::filesystem::path playlistDir = playlist.path;
+  loader->addFutures.emplace_back(ThreadPool::submit([playlistDir, loader, files = std::move(files)]() {
+        addFilesAsync(playlistDir, *loader, files);
+        }));
   return FileStatus::Success;
 }
-
-FileStatus Playlist::removeFile(const std::filesystem::path& path, uint32_t playlistIndex) {
+FileStatus Playlist::appendFiles(const std::vector<std::string>& paths, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
-  if(!Playlist::containsFile(path, playlistIndex)) return FileStatus::Failed;
-
-  for(auto& file : playlist.musicFiles) {
-    if(file.path == path) {
-      playlist.musicFiles.erase(std::find(playlist.musicFiles.begin(), playlist.musicFiles.end(), file));
-      state.loadedPlaylistFilepaths.erase(std::find(state.loadedPlaylistFilepaths.begin(), state.loadedPlaylistFilepaths.end(), path));
-      break;
-    }
+  if(!PlaylistFile::appendFiles(playlist.path, paths)) return FileStatus::Failed;
+  for(const auto& path : paths) {
+    PlaylistMembership::add(TrackTable::intern(path), playlist.id);
   }
-  return Playlist::save(playlistIndex);
+  return FileStatus::Success;
 }
 
-bool Playlist::containsFile(const std::filesystem::path& path, uint32_t playlistIndex) {
+FileStatus Playlist::removeFile(const std::filesystem::path& path, uint32_t playlistIndex) {
   Playlist& playlist = state.playlists[playlistIndex];
-  for(auto& file : playlist.musicFiles) {
-    if(file.path == path) return true;
-  }
-  return false;
-}
-bool Playlist::metadataContainsFile(const std::string& path, uint32_t playlistIndex) {
-  std::ifstream file(state.playlists[playlistIndex].path.string() + "/.metadata");
-  std::string line;
-
-  if (file.is_open()) {
-    while (std::getline(file, line)) {
-      if (line.find(path) != std::string::npos) {
-        file.close();
-        return true;
-      }
+
+  // The playlist does not need to be loaded, the removal is journaled
+  auto trackIt = std::find(playlist.tracks.begin(), playlist.tracks.end(), TrackTable::find(path));
+  if(trackIt != playlist.tracks.end()) {
+    playlist.tracks.erase(trackIt);
+    std::vector<std::string>& filepaths = playlist.loader->filepaths;
+    auto it = std::find(filepaths.begin(), filepaths.end(), path);
+    if(it != filepaths.end()) {
+      filepaths.erase(it);
     }
-    file.close();
-  } else {
-    LOG_ERROR("[Error] Failed to open the metadata of playlist on path '%s'\n", state.playlists[playlistIndex].path.c_str());
   }
-
-  return false;
-}
-
-std::string PlaylistMetadata::getName(const std::filesystem::directory_entry& playlistDir) {
-  return getMetadataValue(playlistDir, "name:");
-
+  if(!PlaylistFile::removeFile(playlist.path, path.string())) return FileStatus::Failed;
+  PlaylistMembership::remove(TrackTable::find(path), playlist.id);
+  return FileStatus::Success;
 }
 
-std::string PlaylistMetadata::getDesc(const std::filesystem::directory_entry& playlistDir) {
-  return getMetadataValue(playlistDir, "desc:");
+bool Playlist::containsFile(const std::filesystem::path& path, uint32_t playlistIndex) {
+  return PlaylistMembership::query(path, state.playlists[playlistIndex].id) == Membership::Present;
 }
-
-std::string PlaylistMetadata::getUrl(const std::filesystem::directory_entry& playlistDir) {
-  return getMetadataValue(playlistDir, "url:");
+bool Playlist::containsTrack(TrackId id, uint32_t playlistIndex) {
+  return PlaylistMembership::query(id, state.playlists[playlistIndex].id) == Membership::Present;
 }
 
-std::string PlaylistMetadata::getThumbnailPath(const std::filesystem::directory_entry& playlistDir) {
-  return getMetadataValue(playlistDir, "thumbnail:");
+PlaylistInfo PlaylistMetadata::getInfo(const std::filesystem::directory_entry& playlistDir) {
+  PlaylistInfo info;
+  if(!PlaylistFile::readInfo(playlistDir.path(), info)) {
+    LOG_ERROR("Failed to read the header of playlist on path '%s'\n", playlistDir.path().string().c_str());
+  }
+  return info;
 }
 
 std::vector<std::string> PlaylistMetadata::getFilepaths(const std::filesystem::directory_entry& playlistDir) {
-  std::ifstream metadata(playlistDir.path().string() + "/.metadata");
   std::vector<std::string> filepaths{};
-
-  if(!metadata.is_open()) {
+  PlaylistFile::View view;
+  if(!view.open(playlistDir.path())) {
     LOG_ERROR("Failed to open the metadata of playlist on path '%s'\n", playlistDir.path().string().c_str());
     return filepaths;
   }
-
-  std::string line;
-  while(std::getline(metadata, line)) {
-    std::istringstream iss(line);
-    std::string key;
-    iss >> key;
-
-    if (line.find("files:") != std::string::npos) {
-      // If the line contains "files:", extract paths from the rest of the line
-      std::istringstream iss(line.substr(line.find("files:") + std::string("files:").length()));
-      std::string path;
-
-      while (iss >> std::quoted(path)) {
-        filepaths.emplace_back(path);
-      }
-    }
+  filepaths.reserve(view.getFileCount());
+  for(uint32_t i = 0; i < view.getFileCount(); i++) {
+    filepaths.emplace_back(view.getFilepath(i));
   }
   return filepaths;
 }
-
@@ -1,37 +1,70 @@
 #pragma once 
 
 #include "config.hpp"
+#include "imageScaler.hpp"
+#include "playlistFile.hpp"
+#include "slotMap.hpp"
+#include "trackLoader.hpp"
+#include "trackTable.hpp"
 #include <filesystem>
 
 extern "C" {
 #include <leif/leif.h>
 }
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+// Stays valid while the playlist exists, indices into state.playlists shift
+// when a playlist is removed
+typedef SlotHandle PlaylistHandle;
+#define PLAYLIST_HANDLE_NONE SLOT_HANDLE_NONE
+
+// Track of a Playlist::addFiles batch, appended to the playlist once the
+// batch is merged
+struct AddedTrack {
+  TrackId id;
+  // Invalid tracks are only dropped from the membership index
+  bool valid;
+};
+
+// Loading state of one playlist, so several playlists load at the same time.
+// Shared with the add batches of the playlist, which may outlive it.
+struct PlaylistLoadContext {
+  // Paths of the playlist file, read when the playlist is loaded
+  std::vector<std::string> filepaths;
+
+  // Load of the tracks, it is cancelled once the playlist is off screen and
+  // resumed when it is shown again. Background loads warm the playlist and
+  // run until they finish.
+  LoadGeneration generation = LOAD_GENERATION_NONE;
+  bool cancelled = false, background = false;
+
+  // Running Playlist::addFiles batches, their tracks are appended by the UI
+  // thread once all of them finished
+  std::vector<std::future<void>> addFutures;
+  std::vector<AddedTrack> addedTracks;
+  std::mutex mutex;
+  // Progress of the batches, read without the lock
+  std::atomic<uint32_t> addDone{0}, addTotal{0};
+};
+
 enum class FileStatus {
   None = 0,
   Success,
   Failed,
   AlreadyExists, 
 };
-struct SoundFile {
-  std::filesystem::path path;
-  std::string artist, title;
-  uint32_t releaseYear;
-  int32_t duration;
-  LfTexture thumbnail;
-  bool loaded;
-
-  float renderPosY;
-
-  bool operator==(const SoundFile& other) const {
-    return path == other.path;
-  }
-};
 struct Playlist {
-  std::vector<SoundFile> musicFiles;
+  // IDs into the TrackTable
+  std::vector<TrackId> tracks;
+  // ID in the PlaylistMembership index
+  uint32_t id = 0;
+  PlaylistHandle handle;
 
   std::string name, desc, url;
   // Moving the file that is being dragged  
@@ -40,11 +73,27 @@ struct Playlist {
   int32_t playingFile = -1, selectedFile = -1;
 
   bool loaded = false;
+  std::shared_ptr<PlaylistLoadContext> loader = std::make_shared<PlaylistLoadContext>();
 
   bool operator==(const Playlist& other) const { 
     return path == other.path;
   }
+  SoundFile& file(uint32_t i) const {
+    return TrackTable::get(tracks[i]);
+  }
+  // Rows have a fixed height, so their positions are computed from the
+  // position of the first row instead of being stored per track
+  float rowPosY(uint32_t i) const {
+    return rowsPosY + i * rowHeight;
+  }
   float scroll = 0.0f, scrollVelocity = 0.0f;
+  float rowsPosY = 0.0f, rowHeight = 0.0f;
+
+  // Appends the playlist to state.playlists and assigns its handle, returns its index
+  static uint32_t add(const Playlist& playlist);
+  // NULL and -1 once the playlist was removed
+  static Playlist* get(PlaylistHandle handle);
+  static int32_t indexOf(PlaylistHandle handle);
 
   static FileStatus create(const std::string& name, const std::string& desc, const std::string& url = "",
       const std::filesystem::path& thumbnailPath = "");
@@ -53,19 +102,27 @@ struct Playlist {
   static FileStatus save(uint32_t playlistIndex);
   static FileStatus changeDesc(const std::string& desc, uint32_t playlistIndex);
   static FileStatus changeThumbnail(const std::filesystem::path& thumbnailPath, uint32_t playlistIndex);
+  // Single file batch of addFiles
   static FileStatus addFile(const std::filesystem::path& path, uint32_t playlistIndex);
+  // Adds the files in one batch. Files that are part of the playlist already
+  // are skipped, the rest is validated and parsed on the ThreadPool without
+  // the global lock and appended with a single journal write.
+  // The rows show up when handleAsyncPlaylistLoading merges the batch.
+  static FileStatus addFiles(const std::vector<std::filesystem::path>& paths, uint32_t playlistIndex);
+  // Journals the files without adding them to the loaded track list
+  static FileStatus appendFiles(const std::vector<std::string>& paths, uint32_t playlistIndex);
   static FileStatus removeFile(const std::filesystem::path& path, uint32_t playlistIndex);
 
+  // Looked up in the membership index, the playlist does not need to be loaded.
+  // False until the index job of the playlist finished.
   static bool containsFile(const std::filesystem::path& path, uint32_t playlistIndex);
-  static bool metadataContainsFile(const std::string& path, uint32_t playlistIndex);
+  static bool containsTrack(TrackId id, uint32_t playlistIndex);
 
 };
 
 namespace PlaylistMetadata {
-  std::string getName(const std::filesystem::directory_entry& playlistDir); 
-  std::string getDesc(const std::filesystem::directory_entry& playlistDir); 
-  std::string getUrl(const std::filesystem::directory_entry& playlistDir); 
-  std::string getThumbnailPath(const std::filesystem::directory_entry& playlistDir); 
+  // Name, description, url and thumbnail in one read, without the file list
+  PlaylistInfo getInfo(const std::filesystem::directory_entry& playlistDir); 
   std::vector<std::string> getFilepaths(const std::filesystem::directory_entry& playlistDir); 
 }
 
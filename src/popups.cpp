@@ -9,6 +9,7 @@
 
 #include "playlists.hpp"
 #include "soundTagParser.hpp"
+#include "playlistFile.hpp"
 
 #include <cstring>
 #include <fstream>
@@ -120,22 +121,8 @@ void EditPlaylistPopup::render() {
     props.margin_top = 15;
     lf_push_style_props(props);
     if(lf_button_fixed("Done", 150, -1) == LF_CLICKED) {
-      std::vector<std::string> playlistFilepaths =  PlaylistMetadata::getFilepaths(std::filesystem::directory_entry(currentPlaylist.path));
-
       Playlist::rename(std::string(nameBuf), state.currentPlaylist);
       Playlist::changeDesc(std::string(descBuf), state.currentPlaylist);
-
-      bool playlistEmpty = currentPlaylist.musicFiles.empty();
-      if(playlistEmpty) {
-        for(auto& filepath : playlistFilepaths) {
-          currentPlaylist.musicFiles.emplace_back((SoundFile){.path = filepath});
-        }
-      }
-      Playlist::save(state.currentPlaylist);
-      if(playlistEmpty) {
-        currentPlaylist.musicFiles.clear();
-        currentPlaylist.musicFiles.shrink_to_fit();
-      }
       this->shouldRender = false;
 
       memset(nameBuf, 0, INPUT_BUFFER_SIZE);
@@ -176,7 +163,7 @@ void PlaylistFileDialoguePopup::render() {
     static const char* options[options_count];
     options[0] = "Add to playlist...";
     options[1] = "Remove";
-    options[2] = Playlist::metadataContainsFile(this->path.string(), 0) ? "Remove from favourites" : "Add to favourites";
+    options[2] = Playlist::containsFile(this->path, 0) ? "Remove from favourites" : "Add to favourites";
     if(state.currentTab == GuiTab::Dashboard && state.dashboardTab == DashboardTab::Favourites) {
       options[2] = "";
     }
@@ -222,11 +209,11 @@ void PlaylistFileDialoguePopup::render() {
         }
       case 1: /* Remove */
         {
-          if(state.currentSoundFile != nullptr) {
-            if(state.currentSoundFile->path == this->path) {
+          if(state.currentTrack != TRACK_ID_NONE) {
+            if(TrackTable::get(state.currentTrack).path() == this->path) {
               state.soundHandler.stop();
               state.soundHandler.uninit();
-              state.currentSoundFile = nullptr;
+              state.currentTrack = TRACK_ID_NONE;
             }
           }
           Playlist::removeFile(this->path, state.currentPlaylist);
@@ -237,19 +224,8 @@ void PlaylistFileDialoguePopup::render() {
         }
       case 2: /* Add to favourites */
         {
-          if(Playlist::metadataContainsFile(this->path.string(), 0)) {
-            Playlist& favourites = state.playlists[0];
-            if(!favourites.loaded) {
-              std::vector<std::string> paths = PlaylistMetadata::getFilepaths(
-                  std::filesystem::directory_entry(state.playlists[0].path));
-              for(auto& path : paths) {
-                favourites.musicFiles.push_back((SoundFile){.path = path});
-              }
-              Playlist::removeFile(this->path.string(), 0);
-              favourites.musicFiles.clear();
-            } else {
-              Playlist::removeFile(this->path.string(), 0);
-            }
+          if(Playlist::containsFile(this->path, 0)) {
+            Playlist::removeFile(this->path.string(), 0);
             this->shouldRender = false;
             lf_div_ungrab();
             state.infoCards.addCard("Removed from favourites.");
@@ -257,13 +233,8 @@ void PlaylistFileDialoguePopup::render() {
             Playlist& favourites = state.playlists[0]; // 0th playlist is favourites
             if(favourites.loaded) {
               Playlist::addFile(this->path, 0);
-              favourites.loaded = false;
             } else {
-              std::ofstream metadata(favourites.path.string() + "/.metadata", std::ios::app);
-              metadata.seekp(0, std::ios::end);
-
-              metadata << "\"" << this->path.string() << "\" ";
-              metadata.close();
+              Playlist::appendFiles({this->path.string()}, 0);
             }
             this->shouldRender = false;
             lf_div_ungrab();
@@ -286,21 +257,24 @@ void PlaylistFileDialoguePopup::render() {
       case 4: /* Set thumbnail */
         {
           Playlist& playlist = state.playlists[state.currentPlaylist];
-          TextureData fullscaleThumb = SoundTagParser::getSoundThubmnailData(this->path.string(), (vec2s){-1, -1});
+          // The file keeps the full resolution, the homepage card only needs the card level
+          ThumbnailPyramid pyramid = SoundTagParser::getSoundThumbnailPyramid(this->path.string(), 
+              THUMBNAIL_LEVEL_BIT(ThumbnailLevel::Full) | THUMBNAIL_LEVEL_BIT(ThumbnailLevel::Card));
+          const TextureData& fullscaleThumb = pyramid.level(ThumbnailLevel::Full);
 
-          if (!stbi_write_jpg(std::string(playlist.path.string() + "/thumbnail.jpg.jpg").c_str(), fullscaleThumb.width, fullscaleThumb.height, 
+          if (!fullscaleThumb.data || !stbi_write_jpg(std::string(playlist.path.string() + "/thumbnail.jpg.jpg").c_str(), fullscaleThumb.width, fullscaleThumb.height, 
                 fullscaleThumb.channels, fullscaleThumb.data, 100)) {
             LOG_ERROR("Failed to write thumbnail file.");
+            ImageScaler::freeThumbnailPyramid(pyramid);
             break;
           }
-          lf_create_texture_from_image_data(LF_TEX_FILTER_LINEAR, &playlist.thumbnail.id, 
-              fullscaleThumb.width, fullscaleThumb.height, fullscaleThumb.channels, fullscaleThumb.data);
-
-          playlist.thumbnail.width = fullscaleThumb.width;
-          playlist.thumbnail.height = fullscaleThumb.height;
+          if(playlist.thumbnail.width != 0) {
+            lf_free_texture(&playlist.thumbnail);
+          }
+          playlist.thumbnail = ImageScaler::createTexture(pyramid.level(ThumbnailLevel::Card));
+          ImageScaler::freeThumbnailPyramid(pyramid);
 
-          playlist.thumbnailPath = std::filesystem::path(playlist.path.string() + "/thumbnail.jpg.jpg");
-          Playlist::save(state.currentPlaylist);
+          Playlist::changeThumbnail(std::filesystem::path(playlist.path.string() + "/thumbnail.jpg.jpg"), state.currentPlaylist);
           this->shouldRender = false;
           lf_div_ungrab();
           state.infoCards.addCard("Changed thumbnail of playlist.");
@@ -336,7 +310,7 @@ void PlaylistFileDialoguePopup::render() {
         Playlist& playlist = state.playlists[i];
         if(playlist.path.filename() == "favourites") continue;
         if(i == state.currentPlaylist) continue;
-        if( Playlist::metadataContainsFile(this->path, i)) continue;
+        if(Playlist::containsFile(this->path, i)) continue;
 
         LfUIElementProps props = secondary_button_style();
         lf_push_style_props(props);
@@ -344,13 +318,8 @@ void PlaylistFileDialoguePopup::render() {
           if(playlist.loaded) {
             Playlist::addFile(this->path, i);
           } else {
-            std::ofstream metadata(playlist.path.string() + "/.metadata", std::ios::app);
-            metadata.seekp(0, std::ios::end);
-
-            metadata << "\"" << this->path.string() << "\" ";
-            metadata.close();
+            Playlist::appendFiles({this->path.string()}, i);
           }
-          playlist.loaded = false;
           this->shouldRender = false;
           onPlaylistAddTab = false;
           lf_set_current_div_scroll(0.0f);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Handle of an entry in a SlotMap. A slot is reused once its entry is
+// removed, its generation is bumped then, so a handle that outlived its
+// entry never resolves to the entry that took the slot over.
+struct SlotHandle {
+  uint32_t slot = UINT32_MAX, generation = 0;
+
+  bool operator==(const SlotHandle& other) const {
+    return slot == other.slot && generation == other.generation;
+  }
+  bool operator!=(const SlotHandle& other) const {
+    return !(*this == other);
+  }
+};
+
+#define SLOT_HANDLE_NONE SlotHandle{}
+
+// Values addressed by generational handles, lookups are O(1) and validated.
+// Handles are cheap to copy into async work, which looks the value up again
+// once it finished instead of holding a pointer or an index that shifts.
+template<typename T>
+class SlotMap {
+  public:
+    SlotHandle insert(const T& value) {
+      uint32_t slot;
+      if(!_free.empty()) {
+        slot = _free.back();
+        _free.pop_back();
+      } else {
+        slot = (uint32_t)_slots.size();
+        _slots.emplace_back();
+      }
+      Slot& entry = _slots[slot];
+      entry.value = value;
+      entry.used = true;
+      return {slot, entry.generation};
+    }
+
+    void remove(SlotHandle handle) {
+      if(!get(handle)) return;
+      Slot& entry = _slots[handle.slot];
+      entry.used = false;
+      entry.generation++;
+      entry.value = T{};
+      _free.emplace_back(handle.slot);
+    }
+
+    // NULL if the entry was removed
+    T* get(SlotHandle handle) {
+      if(handle.slot >= _slots.size()) return NULL;
+      Slot& entry = _slots[handle.slot];
+      if(!entry.used || entry.generation != handle.generation) return NULL;
+      return &entry.value;
+    }
+
+  private:
+    struct Slot {
+      T value{};
+      uint32_t generation = 0;
+      bool used = false;
+    };
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _free;
+};
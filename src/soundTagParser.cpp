@@ -2,6 +2,7 @@
 #include "log.hpp"
 #include "soundHandler.hpp"
 #include "utils.hpp"
+#include "imageScaler.hpp"
 
 #include <taglib/tag.h>
 #include <taglib/fileref.h>
@@ -13,37 +14,49 @@
 #include <taglib/tfile.h>
 
 #include <iostream>
+#include <stdlib.h>
 
 using namespace TagLib;
 
-namespace SoundTagParser {
-  LfTexture getSoundThubmnail(const std::string& soundPath, vec2s size_factor) {
-    MPEG::File file(soundPath.c_str());
+static bool getTagPictureData(ID3v2::Tag* tag, const std::string& soundPath, ByteVector& imageData) {
+  if (!tag) {
+    LOG_ERROR("No ID3v2 tag found for file '%s'.\n", soundPath.c_str());
+    return false;
+  }
 
-    LfTexture tex = {0};
-    // Get the ID3v2 tag
-    ID3v2::Tag *tag = file.ID3v2Tag();
-    if (!tag) {
-      LOG_ERROR("No ID3v2 tag found for file '%s'.\n", soundPath.c_str());
-      return tex;
-    }
+  // Get the first APIC (Attached Picture) frame
+  ID3v2::FrameList apicFrames = tag->frameListMap()["APIC"];
+  if (apicFrames.isEmpty()) {
+    LOG_ERROR("No APIC frame found for file '%s'.\n", soundPath.c_str());
+    return false;
+  }
 
-    // Get the first APIC (Attached Picture) frame
-    ID3v2::FrameList apicFrames = tag->frameListMap()["APIC"];
-    if (apicFrames.isEmpty()) {
-      LOG_ERROR("No APIC frame found for file '%s'.\n", soundPath.c_str());
-      return tex;
-    }
+  // Extract the image data
+  ID3v2::AttachedPictureFrame *apicFrame = dynamic_cast<ID3v2::AttachedPictureFrame *>(apicFrames.front());
+  if (!apicFrame) {
+    LOG_ERROR("Failed to cast APIC frame for file '%s'.\n", soundPath.c_str());
+    return false;
+  }
 
-    // Extract the image data
-    ID3v2::AttachedPictureFrame *apicFrame = dynamic_cast<ID3v2::AttachedPictureFrame *>(apicFrames.front());
-    if (!apicFrame) {
-      LOG_ERROR("Failed to cast APIC frame for file '%s'.\n", soundPath.c_str());
+  imageData = apicFrame->picture();
+  return true;
+}
+
+static bool getSoundPictureData(const std::string& soundPath, ByteVector& imageData) {
+  MPEG::File file(soundPath.c_str());
+
+  // Get the ID3v2 tag
+  return getTagPictureData(file.ID3v2Tag(), soundPath, imageData);
+}
+
+namespace SoundTagParser {
+  LfTexture getSoundThubmnail(const std::string& soundPath, vec2s size_factor) {
+    LfTexture tex = {0};
+    ByteVector imageData;
+    if(!getSoundPictureData(soundPath, imageData)) {
       return tex;
     }
 
-    ByteVector imageData = apicFrame->picture();
-
     if(size_factor.x == -1 || size_factor.y == -1)
       tex = lf_load_texture_from_memory(imageData.data(), (int)imageData.size(), true, LF_TEX_FILTER_LINEAR);
     else 
@@ -53,41 +66,41 @@ namespace SoundTagParser {
   }
 
   TextureData getSoundThubmnailData(const std::string& soundPath, vec2s size_factor) {
-    MPEG::File file(soundPath.c_str());
     TextureData retData{};
-
-    // Get the ID3v2 tag
-    ID3v2::Tag *tag = file.ID3v2Tag();
-    if (!tag) {
-      LOG_ERROR("No ID3v2 tag found for file '%s'.\n", soundPath.c_str());
-      return retData;
-    }
-
-    // Get the first APIC (Attached Picture) frame
-    ID3v2::FrameList apicFrames = tag->frameListMap()["APIC"];
-    if (apicFrames.isEmpty()) {
-      LOG_ERROR("No APIC frame found for file '%s'.\n", soundPath.c_str());
+    ByteVector imageData;
+    if(!getSoundPictureData(soundPath, imageData)) {
       return retData;
     }
 
-    // Extract the image data
-    ID3v2::AttachedPictureFrame *apicFrame = dynamic_cast<ID3v2::AttachedPictureFrame *>(apicFrames.front());
-    if (!apicFrame) {
-      LOG_ERROR("Failed to cast APIC frame for file '%s'.\n", soundPath.c_str());
-      return retData;
+    retData.data = lf_load_texture_data_from_memory(imageData.data(), (size_t)imageData.size(), (int32_t*)&retData.width, (int32_t*)&retData.height, &retData.channels, true); 
+    if(retData.data && size_factor.x != -1 && size_factor.y != -1) {
+      TextureData fullscale = retData;
+      retData = ImageScaler::areaDownscaleToFit(fullscale, (uint32_t)size_factor.x, (uint32_t)size_factor.y);
+      free(fullscale.data);
     }
+    retData.path = soundPath;
 
-    ByteVector imageData = apicFrame->picture();
+    return retData;
+  }
 
-    if(size_factor.x == -1 || size_factor.y == -1) {
-      retData.data = lf_load_texture_data_from_memory(imageData.data(), (size_t)imageData.size(), (int32_t*)&retData.width, (int32_t*)&retData.height, &retData.channels, true); 
-    } else  {
-      retData.data = lf_load_texture_data_from_memory_resized(imageData.data(), (size_t)imageData.size(), 
-          (int32_t*)&retData.channels, (int32_t*)&retData.width, (int32_t*)&retData.height,  true, 48, 27); 
+  ThumbnailPyramid getSoundThumbnailPyramid(const std::string& soundPath, uint32_t levelMask) {
+    ThumbnailPyramid pyramid{};
+    ByteVector imageData;
+    if(getSoundPictureData(soundPath, imageData)) {
+      pyramid = ImageScaler::buildThumbnailPyramid(imageData.data(), (size_t)imageData.size(), levelMask);
     }
-    retData.path = soundPath;
+    pyramid.path = soundPath;
+    return pyramid;
+  }
 
-    return retData;
+  bool getSoundPicture(const std::string& soundPath, std::vector<unsigned char>& picture) {
+    ByteVector imageData;
+    if(!getSoundPictureData(soundPath, imageData)) {
+      return false;
+    }
+    const unsigned char* bytes = (const unsigned char*)imageData.data();
+    picture.assign(bytes, bytes + imageData.size());
+    return true;
   }
 
   std::string getSoundArtist(const std::string& soundPath) {
@@ -172,6 +185,38 @@ namespace SoundTagParser {
 
     return metadata;
   }
+  bool getSoundTags(const std::string& soundPath, SoundMetadata& metadata, std::vector<unsigned char>* picture) {
+    metadata.artist = "None";
+    metadata.title = "No Title";
+    metadata.releaseYear = 0;
+    metadata.duration = 0;
+    if(picture) picture->clear();
+
+    FileRef fileRef(soundPath.c_str());
+    if(fileRef.isNull()) return false;
+
+    if(fileRef.audioProperties()) {
+      metadata.duration = fileRef.audioProperties()->length();
+    }
+    if(fileRef.tag()) {
+      Tag *tag = fileRef.tag();
+      metadata.artist = tag->artist().to8Bit(true);
+      metadata.title = tag->title().to8Bit(true);
+      metadata.releaseYear = tag->year();
+    }
+
+    if(picture) {
+      // Covers are only read from ID3v2 tags
+      MPEG::File* file = dynamic_cast<MPEG::File*>(fileRef.file());
+      ByteVector imageData;
+      if(file && getTagPictureData(file->ID3v2Tag(), soundPath, imageData)) {
+        const unsigned char* bytes = (const unsigned char*)imageData.data();
+        picture->assign(bytes, bytes + imageData.size());
+      }
+    }
+    return true;
+  }
+
   SoundMetadata getSoundMetadataNoThumbnail(const std::string& soundPath) {
     SoundMetadata metadata;
     metadata.duration = SoundTagParser::getSoundDuration(soundPath);
@@ -4,8 +4,10 @@ extern "C" {
 #include <leif/leif.h>
 }
 #include <string>
+#include <vector>
 
 #include "textureData.hpp"
+#include "imageScaler.hpp"
 
 struct SoundMetadata {
   std::string artist, title;
@@ -18,6 +20,8 @@ struct SoundMetadata {
 namespace SoundTagParser {
   LfTexture getSoundThubmnail(const std::string& soundPath, vec2s size_factor = (vec2s){-1, -1});
   TextureData getSoundThubmnailData(const std::string& soundPath, vec2s size_factor = (vec2s){-1, -1});
+  ThumbnailPyramid getSoundThumbnailPyramid(const std::string& soundPath, uint32_t levelMask);
+  bool getSoundPicture(const std::string& soundPath, std::vector<unsigned char>& picture);
   std::string getSoundArtist(const std::string& soundPath);
   std::string getSoundAlbum(const std::string& soundPath);
   std::string getSoundTitle(const std::string& soundPath);
@@ -26,5 +30,8 @@ namespace SoundTagParser {
   std::string getSoundComment(const std::string& soundPath);
   SoundMetadata getSoundMetadata(const std::string& soundPath);
   SoundMetadata getSoundMetadataNoThumbnail(const std::string& soundPath);
+  // Artist, title, release year, duration and optionally the encoded cover
+  // from a single parse of the file
+  bool getSoundTags(const std::string& soundPath, SoundMetadata& metadata, std::vector<unsigned char>* picture);
   bool isValidSoundFile(const std::string& path);
 }
@@ -0,0 +1,120 @@
+#include "stringPool.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define STRING_BUCKET_BITS 8 // Size of the first bucket, 256 strings
+#define STRING_BUCKET_COUNT 26 // Enough buckets for every 32 bit handle
+
+struct PathNode {
+  PathId parent;
+  StringId name;
+};
+
+// Only intern takes the lock. The strings live in buckets that double in
+// size and never move, a handle is only read once the count published it,
+// so get reads without locking while another thread interns.
+static std::mutex stringMutex;
+static std::atomic<std::string*> stringBuckets[STRING_BUCKET_COUNT];
+static std::atomic<uint32_t> stringCount{0};
+static std::unordered_map<std::string_view, StringId> stringIds;
+
+static std::string& stringSlot(std::string* bucket, uint64_t index, uint32_t bucketIndex) {
+  return bucket[index - ((uint64_t)1 << (bucketIndex + STRING_BUCKET_BITS))];
+}
+
+static uint32_t bucketOf(uint64_t index) {
+  return (uint32_t)(63 - __builtin_clzll(index)) - STRING_BUCKET_BITS;
+}
+
+// Called with the lock held
+static StringId appendString(std::string_view str) {
+  StringId id = stringCount.load(std::memory_order_relaxed);
+  uint64_t index = (uint64_t)id + ((uint64_t)1 << STRING_BUCKET_BITS);
+  uint32_t bucketIndex = bucketOf(index);
+  std::string* bucket = stringBuckets[bucketIndex].load(std::memory_order_relaxed);
+  if(!bucket) {
+    bucket = new std::string[(size_t)1 << (bucketIndex + STRING_BUCKET_BITS)];
+    stringBuckets[bucketIndex].store(bucket, std::memory_order_release);
+  }
+  std::string& slot = stringSlot(bucket, index, bucketIndex);
+  slot = str;
+  stringIds.emplace(slot, id);
+  stringCount.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+// Handle 0 is the empty string
+static StringId emptyStringId = appendString("");
+
+static std::vector<PathNode> pathNodes = {{0, 0}};
+static std::unordered_map<uint64_t, PathId> pathChildren;
+
+static uint64_t childKey(PathId parent, StringId name) {
+  return ((uint64_t)parent << 32) | name;
+}
+
+namespace StringPool {
+  StringId intern(std::string_view str) {
+    std::lock_guard<std::mutex> lock(stringMutex);
+    auto it = stringIds.find(str);
+    if(it != stringIds.end()) return it->second;
+    return appendString(str);
+  }
+
+  StringId find(std::string_view str) {
+    std::lock_guard<std::mutex> lock(stringMutex);
+    auto it = stringIds.find(str);
+    return it != stringIds.end() ? it->second : STRING_ID_NONE;
+  }
+
+  const std::string& get(StringId id) {
+    if(id >= stringCount.load(std::memory_order_acquire)) id = emptyStringId;
+    uint64_t index = (uint64_t)id + ((uint64_t)1 << STRING_BUCKET_BITS);
+    uint32_t bucketIndex = bucketOf(index);
+    return stringSlot(stringBuckets[bucketIndex].load(std::memory_order_acquire), index, bucketIndex);
+  }
+}
+
+namespace PathPool {
+  PathId intern(const std::filesystem::path& dir) {
+    PathId id = 0;
+    for(const auto& component : dir) {
+      if(component.empty()) continue;
+      StringId name = StringPool::intern(component.string());
+      auto [it, inserted] = pathChildren.try_emplace(childKey(id, name), (PathId)pathNodes.size());
+      if(inserted) {
+        pathNodes.push_back({id, name});
+      }
+      id = it->second;
+    }
+    return id;
+  }
+
+  PathId find(const std::filesystem::path& dir) {
+    PathId id = 0;
+    for(const auto& component : dir) {
+      if(component.empty()) continue;
+      StringId name = StringPool::find(component.string());
+      if(name == STRING_ID_NONE) return PATH_ID_NONE;
+      auto it = pathChildren.find(childKey(id, name));
+      if(it == pathChildren.end()) return PATH_ID_NONE;
+      id = it->second;
+    }
+    return id;
+  }
+
+  std::filesystem::path get(PathId id) {
+    std::vector<StringId> names;
+    for(; id != 0; id = pathNodes[id].parent) {
+      names.push_back(pathNodes[id].name);
+    }
+    std::filesystem::path dir;
+    for(auto it = names.rbegin(); it != names.rend(); it++) {
+      dir /= StringPool::get(*it);
+    }
+    return dir;
+  }
+}
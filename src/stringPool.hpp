@@ -0,0 +1,38 @@
+#pragma once
+
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Handle of an interned string, equal strings share one handle and 0 is the
+// empty string
+typedef uint32_t StringId;
+#define STRING_ID_NONE UINT32_MAX
+
+// Handle of an interned directory, 0 is the empty path
+typedef uint32_t PathId;
+#define PATH_ID_NONE UINT32_MAX
+
+// Strings that repeat across thousands of tracks, like artists, are stored
+// once and referenced by a 32 bit handle. Interned strings are never freed.
+// Thread safe, the loader tasks intern the tags they parse. Only intern and
+// find lock, get does not.
+namespace StringPool {
+  StringId intern(std::string_view str);
+  // STRING_ID_NONE if the string was never interned
+  StringId find(std::string_view str);
+  // The reference stays valid for the whole session
+  const std::string& get(StringId id);
+}
+
+// Directories are stored as a trie of their components, so the long prefix
+// that all files of a playlist share is stored once. A file is referenced by
+// its directory and its interned filename.
+// Only used from the UI thread.
+namespace PathPool {
+  PathId intern(const std::filesystem::path& dir);
+  // PATH_ID_NONE if the directory was never interned
+  PathId find(const std::filesystem::path& dir);
+  std::filesystem::path get(PathId id);
+}
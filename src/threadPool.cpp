@@ -0,0 +1,175 @@
+#include "threadPool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+typedef std::function<void()> Task;
+
+struct Worker {
+  std::mutex mutex;
+  std::deque<Task> tasks[TASK_PRIORITY_COUNT];
+};
+
+// Shared by ThreadPool::run and the copies of its work on the workers
+struct RunState {
+  std::mutex mutex;
+  std::condition_variable idle;
+  uint32_t active = 0;
+  bool done = false;
+};
+
+static struct {
+  std::once_flag started;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  // Changed under the lock of the worker the task is queued on
+  uint32_t queued = 0;
+  uint32_t nextWorker = 0;
+  bool stopped = false;
+} pool;
+
+static thread_local int32_t workerIndex = -1;
+
+static bool popTask(uint32_t self, Task& task) {
+  uint32_t workerCount = pool.workers.size();
+  for(uint32_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+    for(uint32_t i = 0; i < workerCount; i++) {
+      Worker& worker = *pool.workers[(self + i) % workerCount];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      std::deque<Task>& tasks = worker.tasks[priority];
+      if(tasks.empty()) continue;
+      // Own tasks from the back, their data is likely still cached.
+      // Stolen ones from the front, the oldest task is usually the biggest.
+      if(i == 0) {
+        task = std::move(tasks.back());
+        tasks.pop_back();
+      } else {
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      std::lock_guard<std::mutex> poolLock(pool.mutex);
+      pool.queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void runWorker(uint32_t self) {
+  workerIndex = (int32_t)self;
+  Task task;
+  for(;;) {
+    if(popTask(self, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.wake.wait(lock, []() { return pool.queued > 0 || pool.stopped; });
+    if(pool.stopped && pool.queued == 0) return;
+  }
+}
+
+static void start() {
+  std::call_once(pool.started, []() {
+    uint32_t workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    for(uint32_t i = 0; i < workerCount; i++) {
+      pool.workers.emplace_back(std::make_unique<Worker>());
+    }
+    for(uint32_t i = 0; i < workerCount; i++) {
+      pool.threads.emplace_back(runWorker, i);
+    }
+  });
+}
+
+static void push(Task task, TaskPriority priority) {
+  // Tasks queued by a worker stay on it, the others are spread round robin
+  uint32_t index;
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    index = workerIndex != -1 ? (uint32_t)workerIndex : pool.nextWorker++ % pool.workers.size();
+  }
+  Worker& worker = *pool.workers[index];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  worker.tasks[(uint32_t)priority].emplace_back(std::move(task));
+  std::lock_guard<std::mutex> poolLock(pool.mutex);
+  pool.queued++;
+}
+
+static std::future<void> package(Task& task) {
+  auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+  task = [packaged]() { (*packaged)(); };
+  return packaged->get_future();
+}
+
+namespace ThreadPool {
+  std::future<void> submit(std::function<void()> task, TaskPriority priority) {
+    start();
+    std::future<void> future = package(task);
+    push(std::move(task), priority);
+    pool.wake.notify_one();
+    return future;
+  }
+
+  std::vector<std::future<void>> submitBatch(std::vector<std::function<void()>> tasks, TaskPriority priority) {
+    start();
+    std::vector<std::future<void>> futures;
+    futures.reserve(tasks.size());
+    for(auto& task : tasks) {
+      futures.emplace_back(package(task));
+      push(std::move(task), priority);
+    }
+    pool.wake.notify_all();
+    return futures;
+  }
+
+  void run(const std::function<void()>& work, TaskPriority priority) {
+    start();
+    auto runState = std::make_shared<RunState>();
+    const std::function<void()>* workPtr = &work;
+    for(uint32_t i = 0; i < pool.workers.size(); i++) {
+      // A copy that starts after the call returned does not touch work
+      push([runState, workPtr]() {
+          {
+            std::lock_guard<std::mutex> lock(runState->mutex);
+            if(runState->done) return;
+            runState->active++;
+          }
+          (*workPtr)();
+          std::lock_guard<std::mutex> lock(runState->mutex);
+          runState->active--;
+          runState->idle.notify_all();
+        }, priority);
+    }
+    pool.wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(runState->mutex);
+    runState->done = true;
+    runState->idle.wait(lock, [&]() { return runState->active == 0; });
+  }
+
+  uint32_t getWorkerCount() {
+    start();
+    return pool.workers.size();
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      pool.stopped = true;
+    }
+    pool.wake.notify_all();
+    for(auto& thread : pool.threads) {
+      thread.join();
+    }
+    pool.threads.clear();
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <stdint.h>
+#include <vector>
+
+enum class TaskPriority : uint32_t {
+  // Work the user is waiting for
+  High = 0,
+  Normal,
+  // Long running jobs like duplicate detection or journal compaction
+  Low,
+};
+#define TASK_PRIORITY_COUNT 3
+
+// Process wide pool with one worker per core, one core is left to the UI and
+// audio. Every worker owns a deque per priority: it runs its newest task
+// first and steals the oldest task of another worker when it ran out. Higher
+// priorities are stolen before lower ones are run. All background jobs of
+// Lyssa run here instead of on a thread per task.
+namespace ThreadPool {
+  std::future<void> submit(std::function<void()> task, TaskPriority priority = TaskPriority::Normal);
+  // Spreads the tasks over the workers and wakes them once
+  std::vector<std::future<void>> submitBatch(std::vector<std::function<void()>> tasks, 
+      TaskPriority priority = TaskPriority::Normal);
+
+  // Runs work on the calling thread and on idle workers at the same time.
+  // work pulls its items itself and returns once none are left. The call
+  // returns when every running copy returned and never waits for a copy that
+  // did not start, so tasks of the pool can call it without deadlocking it.
+  void run(const std::function<void()>& work, TaskPriority priority = TaskPriority::Normal);
+
+  uint32_t getWorkerCount();
+
+  // Runs the queued tasks and joins the workers
+  void shutdown();
+}
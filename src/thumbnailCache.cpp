@@ -0,0 +1,495 @@
+#include "thumbnailCache.hpp"
+#include "config.hpp"
+#include "jobs.hpp"
+#include "log.hpp"
+#include "soundTagParser.hpp"
+#include "threadPool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#define THUMBNAIL_TILE_MAGIC 0x4854594c // "LYTH"
+#define THUMBNAIL_TILE_VERSION 1
+#define THUMBNAIL_INDEX_HEADER "lyssa-thumbnail-index 2"
+#define THUMBNAIL_INDEX_COMPACT_LINES 1024 // Stale lines tolerated before a rewrite
+
+namespace {
+  struct IndexEntry {
+    uintmax_t fileSize;
+    int64_t mtime;
+    uint64_t hash;
+  };
+
+  struct TileHeader {
+    uint32_t magic, version;
+    uint32_t width, height;
+    int32_t channels;
+  };
+
+  struct CachedTextures {
+    LfTexture levels[(uint32_t)ThumbnailLevel::LevelCount];
+  };
+
+  std::mutex cacheMutex;
+
+  // Track path -> picture hash, lets known tracks skip parsing the tag entirely
+  std::unordered_map<std::string, IndexEntry> pathIndex;
+  // Read once without the lock, lookups that come first treat it as empty
+  std::once_flag indexOnce;
+  std::atomic<bool> indexLoaded{false};
+  // The index file is a log, changed entries are appended and later lines
+  // win. It is rewritten once the stale lines outgrow the entries.
+  std::vector<std::string> pendingLines;
+  size_t indexLines = 0;
+  bool indexRewrite = false;
+  // Held by the job that writes the index, so writes land in order
+  std::mutex indexWriteMutex;
+
+  // Levels of every hash that already have (or are about to get) a texture
+  std::unordered_map<uint64_t, uint32_t> claimedLevels;
+
+  std::unordered_map<uint64_t, ThumbnailPlaceholder> placeholders;
+
+  // Levels requested by requestTexture, by track path
+  struct TextureRequest {
+    uint64_t hash = THUMBNAIL_HASH_NONE;
+    uint32_t levels = 0;
+    bool pending = false;
+  };
+
+  // Only accessed from the OpenGL thread
+  std::unordered_map<uint64_t, CachedTextures> textures;
+  std::unordered_map<std::string, TextureRequest> textureRequests;
+  float uploadBudget = THUMBNAIL_UPLOAD_BUDGET;
+  double uploadTime = 0.0;
+
+  std::filesystem::path cacheDir() {
+    return LYSSA_DIR + "/cache/thumbnails";
+  }
+
+  std::filesystem::path tilePath(uint64_t hash, uint32_t level) {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx_%u.tile", (unsigned long long)hash, level);
+    return cacheDir() / name;
+  }
+
+  bool readTile(const std::filesystem::path& path, TextureData& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    TileHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == THUMBNAIL_TILE_MAGIC && header.version == THUMBNAIL_TILE_VERSION &&
+      header.channels >= 1 && header.channels <= 4 && header.width && header.height;
+    if(!valid) {
+      fclose(file);
+      return false;
+    }
+
+    size_t size = (size_t)header.width * header.height * header.channels;
+    unsigned char* pixels = (unsigned char*)malloc(size);
+    if(fread(pixels, 1, size, file) != size) {
+      free(pixels);
+      fclose(file);
+      return false;
+    }
+    fclose(file);
+
+    data.data = pixels;
+    data.width = header.width;
+    data.height = header.height;
+    data.channels = header.channels;
+    return true;
+  }
+
+  void writeTile(const std::filesystem::path& path, const TextureData& data) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // Written next to the tile and renamed so a reader never sees half a tile
+    std::filesystem::path tmpPath = path.string() + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if(!file) {
+      LOG_ERROR("Failed to write thumbnail tile '%s'.", path.c_str());
+      return;
+    }
+    TileHeader header = {THUMBNAIL_TILE_MAGIC, THUMBNAIL_TILE_VERSION, data.width, data.height, data.channels};
+    size_t size = (size_t)data.width * data.height * data.channels;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data.data, 1, size, file) == size;
+    fclose(file);
+
+    if(written) {
+      std::filesystem::rename(tmpPath, path, ec);
+    }
+    if(!written || ec) {
+      std::filesystem::remove(tmpPath, ec);
+    }
+  }
+
+  std::string formatEntry(const std::string& path, const IndexEntry& entry) {
+    std::ostringstream line;
+    line << "t " << std::hex << entry.hash << std::dec << " " << entry.fileSize << " " << entry.mtime << " " << path << "\n";
+    return line.str();
+  }
+
+  std::string formatPlaceholder(uint64_t hash, const ThumbnailPlaceholder& placeholder) {
+    char hex[sizeof(placeholder.colors) * 2 + 1];
+    const uint8_t* bytes = &placeholder.colors[0][0];
+    for(size_t i = 0; i < sizeof(placeholder.colors); i++) {
+      snprintf(hex + i * 2, 3, "%02x", bytes[i]);
+    }
+    std::ostringstream line;
+    line << "p " << std::hex << hash << std::dec << " " << hex << "\n";
+    return line.str();
+  }
+
+  void readIndex() {
+    std::unordered_map<std::string, IndexEntry> fileIndex;
+    std::unordered_map<uint64_t, ThumbnailPlaceholder> filePlaceholders;
+    size_t lines = 0;
+    bool rewrite = false;
+
+    std::ifstream file(cacheDir() / "index");
+    std::string line;
+    // Indices of older versions are rebuilt, a missing one gets its header
+    if(!std::getline(file, line) || line != THUMBNAIL_INDEX_HEADER) {
+      rewrite = true;
+    }
+
+    while(!rewrite && std::getline(file, line)) {
+      lines++;
+      std::istringstream iss(line);
+      std::string kind;
+      uint64_t hash;
+      iss >> kind >> std::hex >> hash >> std::dec;
+      if(kind == "t") {
+        IndexEntry entry;
+        std::string path;
+        entry.hash = hash;
+        iss >> entry.fileSize >> entry.mtime;
+        iss.ignore(1);
+        std::getline(iss, path);
+        if(iss.fail() || path.empty()) continue;
+        fileIndex[path] = entry;
+      } else if(kind == "p") {
+        std::string hex;
+        iss >> hex;
+        ThumbnailPlaceholder placeholder{};
+        if(iss.fail() || hex.size() != sizeof(placeholder.colors) * 2) continue;
+        uint8_t* bytes = &placeholder.colors[0][0];
+        for(size_t i = 0; i < sizeof(placeholder.colors); i++) {
+          bytes[i] = (uint8_t)strtoul(hex.substr(i * 2, 2).c_str(), NULL, 16);
+        }
+        placeholder.valid = true;
+        filePlaceholders[hash] = placeholder;
+      }
+    }
+
+    // Entries recorded while the file was read are newer
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for(auto& [path, entry] : fileIndex) {
+      pathIndex.try_emplace(path, entry);
+    }
+    for(auto& [hash, placeholder] : filePlaceholders) {
+      placeholders.try_emplace(hash, placeholder);
+    }
+    indexLines += lines;
+    indexRewrite |= rewrite;
+    indexLoaded = true;
+  }
+
+  // Expects cacheMutex to be unlocked
+  void loadIndex() {
+    std::call_once(indexOnce, readIndex);
+  }
+
+  void attachPlaceholder(ThumbnailPyramid& pyramid) {
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      auto it = placeholders.find(pyramid.hash);
+      if(it != placeholders.end()) {
+        pyramid.placeholder = it->second;
+        return;
+      }
+    }
+    // Built from the smallest level this pyramid carries
+    for(const auto& level : pyramid.levels) {
+      if(!level.data) continue;
+      pyramid.placeholder = ImageScaler::buildPlaceholder(level);
+      if(!pyramid.placeholder.valid) break;
+      std::string line = formatPlaceholder(pyramid.hash, pyramid.placeholder);
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      placeholders[pyramid.hash] = pyramid.placeholder;
+      pendingLines.emplace_back(std::move(line));
+      break;
+    }
+  }
+}
+
+namespace {
+  // Runs as a job. Appends the changed entries, or rewrites the whole index
+  // through a temporary file once it is mostly stale lines.
+  void writeIndex() {
+    std::lock_guard<std::mutex> writeLock(indexWriteMutex);
+    std::vector<std::string> lines;
+    bool rewrite;
+    // Knows whether the file exists and how many lines it holds
+    loadIndex();
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if(pendingLines.empty() && !indexRewrite) return;
+      size_t entries = pathIndex.size() + placeholders.size();
+      rewrite = indexRewrite || indexLines + pendingLines.size() > entries * 2 + THUMBNAIL_INDEX_COMPACT_LINES;
+      if(rewrite) {
+        // Snapshot, the file is written without the lock
+        lines.reserve(entries);
+        for(const auto& [path, entry] : pathIndex) {
+          lines.emplace_back(formatEntry(path, entry));
+        }
+        for(const auto& [hash, placeholder] : placeholders) {
+          lines.emplace_back(formatPlaceholder(hash, placeholder));
+        }
+        pendingLines.clear();
+        indexLines = lines.size();
+        indexRewrite = false;
+      } else {
+        lines.swap(pendingLines);
+        indexLines += lines.size();
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir(), ec);
+    std::filesystem::path indexPath = cacheDir() / "index";
+    if(!rewrite) {
+      std::ofstream file(indexPath, std::ios::app);
+      for(const auto& line : lines) {
+        file << line;
+      }
+      if(!file.good()) {
+        LOG_ERROR("Failed to write the thumbnail cache index.");
+      }
+      return;
+    }
+
+    std::filesystem::path tmpPath = indexPath.string() + ".tmp";
+    bool written;
+    {
+      std::ofstream file(tmpPath);
+      file << THUMBNAIL_INDEX_HEADER << "\n";
+      for(const auto& line : lines) {
+        file << line;
+      }
+      written = file.good();
+    }
+    if(written) {
+      std::filesystem::rename(tmpPath, indexPath, ec);
+    }
+    if(!written || ec) {
+      LOG_ERROR("Failed to write the thumbnail cache index.");
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      indexRewrite = true;
+    }
+  }
+}
+
+namespace ThumbnailCache {
+  uint64_t hashPictureData(const void* data, size_t size) {
+    uint64_t hash = LyssaUtils::hashBytes(data, size);
+    return hash == THUMBNAIL_HASH_NONE ? 1 : hash;
+  }
+
+  bool lookupHash(ThumbnailPyramid& pyramid, ThumbnailSource& source) {
+    std::error_code ec;
+    source.fileSize = std::filesystem::file_size(pyramid.path, ec);
+    if(ec) return false;
+    source.mtime = std::filesystem::last_write_time(pyramid.path, ec).time_since_epoch().count();
+    if(ec) return false;
+    source.valid = true;
+
+    loadIndex();
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = pathIndex.find(pyramid.path.string());
+    if(it == pathIndex.end() || it->second.fileSize != source.fileSize || it->second.mtime != source.mtime) {
+      return false;
+    }
+    pyramid.hash = it->second.hash;
+    return true;
+  }
+
+  void recordHash(ThumbnailPyramid& pyramid, const ThumbnailSource& source, const std::vector<unsigned char>& picture) {
+    pyramid.hash = picture.empty() ? THUMBNAIL_HASH_NONE : hashPictureData(picture.data(), picture.size());
+    IndexEntry entry = {source.fileSize, source.mtime, pyramid.hash};
+    std::string path = pyramid.path.string();
+    std::string line = formatEntry(path, entry);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    pathIndex[path] = entry;
+    pendingLines.emplace_back(std::move(line));
+  }
+
+  uint32_t readLevels(ThumbnailPyramid& pyramid, uint32_t levelMask) {
+    if(pyramid.hash == THUMBNAIL_HASH_NONE) return 0;
+    uint32_t missing;
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      uint32_t& claimed = claimedLevels[pyramid.hash];
+      missing = levelMask & ~claimed;
+      claimed |= levelMask;
+    }
+
+    // Prefer the pre-scaled tiles over decoding the picture
+    uint32_t undecoded = missing;
+    for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::Full; i++) {
+      if((missing & THUMBNAIL_LEVEL_BIT(i)) && readTile(tilePath(pyramid.hash, i), pyramid.levels[i])) {
+        undecoded &= ~THUMBNAIL_LEVEL_BIT(i);
+      }
+    }
+    return undecoded;
+  }
+
+  void decodeLevels(ThumbnailPyramid& pyramid, uint32_t levelMask, const std::vector<unsigned char>& picture) {
+    if(pyramid.hash == THUMBNAIL_HASH_NONE) return;
+    if(levelMask && !picture.empty()) {
+      ThumbnailPyramid decoded = ImageScaler::buildThumbnailPyramid(picture.data(), picture.size(), levelMask);
+      for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::LevelCount; i++) {
+        if(!decoded.levels[i].data) continue;
+        pyramid.levels[i] = decoded.levels[i];
+        // The original resolution is not worth the disk space
+        if(i != (uint32_t)ThumbnailLevel::Full) {
+          writeTile(tilePath(pyramid.hash, i), pyramid.levels[i]);
+        }
+      }
+    }
+    attachPlaceholder(pyramid);
+  }
+
+  void preloadIndex() {
+    ThreadPool::submit([]() { loadIndex(); }, TaskPriority::Low);
+  }
+
+  ThumbnailPlaceholder findPlaceholder(const std::filesystem::path& soundPath) {
+    if(!indexLoaded) return {};
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto entry = pathIndex.find(soundPath.string());
+    if(entry == pathIndex.end()) return {};
+    auto it = placeholders.find(entry->second.hash);
+    return it != placeholders.end() ? it->second : ThumbnailPlaceholder{};
+  }
+
+  void releaseLevels(uint64_t hash, uint32_t levelMask) {
+    if(hash == THUMBNAIL_HASH_NONE || !levelMask) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    claimedLevels[hash] &= ~levelMask;
+  }
+
+  bool isClaimed(uint64_t hash, ThumbnailLevel level) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = claimedLevels.find(hash);
+    return it != claimedLevels.end() && (it->second & THUMBNAIL_LEVEL_BIT((uint32_t)level));
+  }
+
+  void upload(ThumbnailPyramid& pyramid) {
+    if(pyramid.hash == THUMBNAIL_HASH_NONE) return;
+    auto start = std::chrono::steady_clock::now();
+    CachedTextures& cached = textures[pyramid.hash];
+    for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::LevelCount; i++) {
+      if(!pyramid.levels[i].data || cached.levels[i].width != 0) continue;
+      cached.levels[i] = ImageScaler::createTexture(pyramid.levels[i]);
+    }
+    ImageScaler::freeThumbnailPyramid(pyramid);
+    uploadTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void beginFrame(float frameTime) {
+    if(frameTime > 1.0f / TARGET_FRAME_RATE * 1.1f) {
+      uploadBudget = std::max(uploadBudget * 0.5f, THUMBNAIL_UPLOAD_BUDGET_MIN);
+    } else {
+      uploadBudget = std::min(uploadBudget + THUMBNAIL_UPLOAD_BUDGET_MIN * 0.2f, THUMBNAIL_UPLOAD_BUDGET_MAX);
+    }
+    uploadTime = 0.0;
+  }
+
+  bool hasUploadBudget() {
+    return uploadTime < uploadBudget;
+  }
+
+  void discard(std::vector<ThumbnailPyramid>& pyramids) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for(auto& pyramid : pyramids) {
+      // Give the levels back so the next track with this cover provides them
+      for(uint32_t i = 0; i < (uint32_t)ThumbnailLevel::LevelCount; i++) {
+        if(pyramid.levels[i].data) {
+          claimedLevels[pyramid.hash] &= ~THUMBNAIL_LEVEL_BIT(i);
+        }
+      }
+      ImageScaler::freeThumbnailPyramid(pyramid);
+    }
+    pyramids.clear();
+  }
+
+  LfTexture requestTexture(const std::filesystem::path& soundPath, ThumbnailLevel level) {
+    if(soundPath.empty()) return (LfTexture){0};
+    uint32_t levelBit = THUMBNAIL_LEVEL_BIT((uint32_t)level);
+    std::string path = soundPath.string();
+    TextureRequest& request = textureRequests[path];
+    if(request.levels & levelBit) {
+      return request.pending ? (LfTexture){0} : getTexture(request.hash, level);
+    }
+    if(request.pending) return (LfTexture){0};
+    request.levels |= levelBit;
+    request.pending = true;
+
+    // The same steps as the loader, so the tracks of a cover share its
+    // hash, its claims and its single decode
+    Jobs::submit<ThumbnailPyramid>([soundPath, levelBit]() {
+        ThumbnailPyramid pyramid{};
+        pyramid.path = soundPath;
+        ThumbnailSource source;
+        std::vector<unsigned char> picture;
+        if(!lookupHash(pyramid, source)) {
+          if(!source.valid) return pyramid;
+          SoundTagParser::getSoundPicture(soundPath.string(), picture);
+          recordHash(pyramid, source, picture);
+        }
+        uint32_t undecoded = readLevels(pyramid, levelBit);
+        if(undecoded && picture.empty() && !SoundTagParser::getSoundPicture(soundPath.string(), picture)) {
+          releaseLevels(pyramid.hash, undecoded);
+          undecoded = 0;
+        }
+        decodeLevels(pyramid, undecoded, picture);
+        return pyramid;
+        },
+        [path](ThumbnailPyramid& pyramid) {
+        TextureRequest& request = textureRequests[path];
+        request.hash = pyramid.hash;
+        request.pending = false;
+        upload(pyramid);
+        });
+    return (LfTexture){0};
+  }
+
+  LfTexture getTexture(uint64_t hash, ThumbnailLevel level) {
+    auto it = textures.find(hash);
+    if(it == textures.end()) return (LfTexture){0};
+    return it->second.levels[(uint32_t)level];
+  }
+
+  void saveIndex() {
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if(pendingLines.empty() && !indexRewrite) return;
+    }
+    // The lines are taken by the job, so a later call never writes them twice
+    ThreadPool::submit([]() { writeIndex(); }, TaskPriority::Low);
+  }
+}
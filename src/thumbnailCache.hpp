@@ -0,0 +1,81 @@
+#pragma once
+
+#include "imageScaler.hpp"
+
+extern "C" {
+#include <leif/leif.h>
+}
+
+#include <filesystem>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Hash of a track without embedded cover art
+#define THUMBNAIL_HASH_NONE 0
+
+// File the hash of a pyramid was looked up for
+struct ThumbnailSource {
+  uintmax_t fileSize = 0;
+  int64_t mtime = 0;
+  // False if the track could not be stat'ed
+  bool valid = false;
+};
+
+// Cover art is identified by a hash of the embedded picture bytes. Tracks of
+// the same album share one decode, one set of pre-scaled tiles on disk
+// (~/.lyssa/cache/thumbnails) and one GPU texture per level.
+namespace ThumbnailCache {
+  uint64_t hashPictureData(const void* data, size_t size);
+
+  // A cover is loaded in steps, so the loader can run them on separate
+  // stages. Levels only carry pixel data if the hash has no texture yet,
+  // every other track with the same cover gets just the hash. All of them
+  // are thread safe.
+  // Returns true if the index knows the hash of pyramid.path
+  bool lookupHash(ThumbnailPyramid& pyramid, ThumbnailSource& source);
+  // Sets the hash of a picture that was parsed because the index missed
+  void recordHash(ThumbnailPyramid& pyramid, const ThumbnailSource& source, const std::vector<unsigned char>& picture);
+  // Claims the levels no other track provides yet and reads their tiles.
+  // Returns the claimed levels that have to be decoded from the picture.
+  uint32_t readLevels(ThumbnailPyramid& pyramid, uint32_t levelMask);
+  // Decodes the levels from the picture and attaches the placeholder
+  void decodeLevels(ThumbnailPyramid& pyramid, uint32_t levelMask, const std::vector<unsigned char>& picture);
+  // Reads the index on the ThreadPool, so findPlaceholder knows the covers
+  // before the first batch is loaded
+  void preloadIndex();
+  // Placeholder the index recorded for the cover of the track, invalid until
+  // the index was read. Not validated against the file, it is only painted
+  // until the real thumbnail is there.
+  ThumbnailPlaceholder findPlaceholder(const std::filesystem::path& soundPath);
+  // Gives back levels that readLevels claimed and that are never decoded
+  void releaseLevels(uint64_t hash, uint32_t levelMask);
+  // True while a track provides the level of the hash, stays set after the upload
+  bool isClaimed(uint64_t hash, ThumbnailLevel level);
+
+  // Must be called from the thread that owns the OpenGL context. Uploads the
+  // levels of the pyramid (if it carries data) and frees the pixel data.
+  void upload(ThumbnailPyramid& pyramid);
+
+  // Called once per frame with the duration of the last frame. Frames that
+  // missed TARGET_FRAME_RATE halve the upload budget, others grow it again.
+  void beginFrame(float frameTime);
+  // False once the uploads of this frame used up the budget, the first
+  // upload of a frame is always allowed
+  bool hasUploadBudget();
+
+  // Frees pyramids that are never going to be uploaded
+  void discard(std::vector<ThumbnailPyramid>& pyramids);
+
+  // Must be called from the thread that owns the OpenGL context. Shared
+  // texture of the level of the cover of the track. The first request loads
+  // the level as a job, empty texture until it was uploaded.
+  LfTexture requestTexture(const std::filesystem::path& soundPath, ThumbnailLevel level);
+
+  // Shared texture of the given cover, empty texture if there is none
+  LfTexture getTexture(uint64_t hash, ThumbnailLevel level);
+
+  // Appends the changed entries of the path -> hash index to disk as a Low
+  // priority job, the index is rewritten once it holds too many stale lines
+  void saveIndex();
+}
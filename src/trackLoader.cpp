@@ -0,0 +1,486 @@
+#include "trackLoader.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "soundTagParser.hpp"
+#include "thumbnailCache.hpp"
+#include "threadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+enum class LoadStage : uint32_t {
+  // Stats the track and reads the cached tiles of its cover
+  Io = 0,
+  // Parses the tags, the cover is only extracted if it is not cached
+  Parse,
+  // Decodes and scales the cover
+  Decode,
+  // Runs on the UI thread in poll, under the upload budget of the frame
+  Upload,
+  Count
+};
+#define LOAD_STAGE_COUNT (uint32_t)LoadStage::Count
+
+static const char* stageNames[LOAD_STAGE_COUNT] = {"I/O", "parse", "decode", "upload"};
+
+struct LoadSlot {
+  TrackId id;
+  std::string path;
+  SoundFile file;
+  ThumbnailPyramid pyramid;
+  ThumbnailSource source;
+  // The index knew the hash of the cover
+  bool indexed = false;
+  // Encoded cover, only kept while levels have to be decoded from it
+  std::vector<unsigned char> picture;
+  // Levels the slot claimed that are not decoded yet
+  uint32_t undecodedLevels = 0;
+  // Guarded by the batch mutex, set once the slot entered the pipeline
+  bool claimed = false;
+  // The cover levels were given back by a cancel
+  bool released = false;
+  // UI thread only. The metadata is merged as soon as the slot is ready, the
+  // cover when the upload budget allows it.
+  bool merged = false, uploaded = false;
+};
+
+// Track that shows its cover once the texture of the hash exists
+struct TextureWait {
+  TrackId id;
+  LoadGeneration generation;
+};
+
+struct StageStats {
+  std::atomic<uint32_t> items{0};
+  std::atomic<uint64_t> busyNs{0};
+};
+
+struct LoadBatch {
+  explicit LoadBatch(uint32_t size) : slots(size) {}
+  ~LoadBatch() {
+    // Results of a dropped batch are never uploaded
+    std::vector<ThumbnailPyramid> pyramids;
+    for(auto& slot : slots) {
+      if(slot.uploaded || slot.released) continue;
+      ThumbnailCache::releaseLevels(slot.pyramid.hash, slot.undecodedLevels);
+      pyramids.emplace_back(std::move(slot.pyramid));
+    }
+    ThumbnailCache::discard(pyramids);
+  }
+
+  std::vector<LoadSlot> slots;
+  LoadGeneration generation = LOAD_GENERATION_NONE;
+  // Checked by the stage tasks before they run
+  std::atomic<bool> cancelled{false};
+
+  // Every stage hands its slots to the queue of the next one. A stage only
+  // starts a slot if the next queue has room for it, so a slow stage stops
+  // the ones before it instead of letting their results pile up.
+  std::mutex mutex;
+  std::deque<uint32_t> queues[LOAD_STAGE_COUNT];
+  uint32_t running[LOAD_STAGE_COUNT] = {0};
+  // The Io stage takes focused slots first, highest priority last
+  std::vector<uint32_t> focus;
+  // Then the next slot in row order
+  uint32_t cursor = 0;
+
+  StageStats stats[LOAD_STAGE_COUNT];
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  // UI thread only
+  std::unordered_map<TrackId, uint32_t> slotIndex;
+  uint32_t uploadedCount = 0;
+};
+
+// Owned by the UI thread, the tasks keep the batch alive on their own
+static std::vector<std::shared_ptr<LoadBatch>> batches;
+// Tracks of the last prioritize call
+static std::vector<TrackId> focusedTracks;
+static LoadGeneration lastGeneration = LOAD_GENERATION_NONE;
+// The cover of a track may be uploaded by another track with the same cover,
+// in a later frame or another batch
+static std::unordered_map<uint64_t, std::vector<TextureWait>> textureWaits;
+// Covers uploaded since the last poll, only their waits are resolved
+static std::vector<uint64_t> uploadedHashes;
+// Set when a cancel gave cover levels back, the waits for them may be orphaned
+static std::atomic<bool> levelsReleased{false};
+// Tracks that were loaded again because their cover was never provided, they
+// are only retried once
+static std::unordered_set<TrackId> orphanRetries;
+
+// Gives the claimed levels back and frees the pixels, so the next track with
+// the cover provides them
+static void releaseSlot(LoadSlot& slot) {
+  if(slot.released || slot.uploaded) return;
+  slot.released = true;
+  ThumbnailCache::releaseLevels(slot.pyramid.hash, slot.undecodedLevels);
+  slot.undecodedLevels = 0;
+  std::vector<ThumbnailPyramid> pyramids;
+  pyramids.emplace_back(std::move(slot.pyramid));
+  ThumbnailCache::discard(pyramids);
+  slot.pyramid = ThumbnailPyramid{};
+  levelsReleased = true;
+}
+
+static void runIo(LoadSlot& slot) {
+  slot.pyramid.path = slot.path;
+  slot.indexed = ThumbnailCache::lookupHash(slot.pyramid, slot.source);
+  if(slot.indexed) {
+    slot.undecodedLevels = ThumbnailCache::readLevels(slot.pyramid, PLAYLIST_FILE_THUMBNAIL_LEVELS);
+  }
+}
+
+static void runParse(LoadSlot& slot) {
+  if(!slot.source.valid) {
+    slot.file = TrackTable::unloadable();
+    return;
+  }
+  SoundMetadata metadata;
+  bool needsPicture = !slot.indexed || slot.undecodedLevels;
+  SoundTagParser::getSoundTags(slot.path, metadata, needsPicture ? &slot.picture : NULL);
+  slot.file = TrackTable::fromMetadata(metadata);
+  if(!slot.indexed) {
+    // First time the track is seen, its tiles are read here instead
+    ThumbnailCache::recordHash(slot.pyramid, slot.source, slot.picture);
+    slot.undecodedLevels = ThumbnailCache::readLevels(slot.pyramid, PLAYLIST_FILE_THUMBNAIL_LEVELS);
+  }
+  if(!slot.undecodedLevels) {
+    slot.picture = std::vector<unsigned char>();
+  }
+}
+
+static void runDecode(LoadSlot& slot) {
+  if(slot.picture.empty()) {
+    // Nothing to decode from, another track with the cover provides the levels
+    ThumbnailCache::releaseLevels(slot.pyramid.hash, slot.undecodedLevels);
+    slot.undecodedLevels = 0;
+  }
+  ThumbnailCache::decodeLevels(slot.pyramid, slot.undecodedLevels, slot.picture);
+  slot.undecodedLevels = 0;
+  slot.picture = std::vector<unsigned char>();
+  // Painted until the real thumbnail is uploaded
+  slot.file.placeholder = slot.pyramid.placeholder;
+}
+
+static void recordStage(LoadBatch& batch, LoadStage stage, std::chrono::steady_clock::time_point start, uint32_t items) {
+  StageStats& stats = batch.stats[(uint32_t)stage];
+  stats.items += items;
+  stats.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Expects the batch mutex to be locked
+static uint32_t claimNextSlot(LoadBatch& batch) {
+  while(!batch.focus.empty()) {
+    uint32_t i = batch.focus.back();
+    batch.focus.pop_back();
+    if(batch.slots[i].claimed) continue;
+    batch.slots[i].claimed = true;
+    return i;
+  }
+  while(batch.cursor < batch.slots.size()) {
+    uint32_t i = batch.cursor++;
+    if(batch.slots[i].claimed) continue;
+    batch.slots[i].claimed = true;
+    return i;
+  }
+  return UINT32_MAX;
+}
+
+static uint32_t stageConcurrency(LoadStage stage) {
+  if(stage == LoadStage::Io) return TRACK_LOADER_IO_TASKS;
+  return std::max(ThreadPool::getWorkerCount(), 1u);
+}
+
+static uint32_t queueCapacity(LoadStage stage) {
+  // Decoded pixels are the only results that are big
+  if(stage == LoadStage::Upload) return TRACK_LOADER_UPLOAD_QUEUE_SIZE;
+  return TRACK_LOADER_QUEUE_SIZE;
+}
+
+static void runStage(const std::shared_ptr<LoadBatch>& batch, LoadStage stage, uint32_t i);
+
+// Expects the batch mutex to be locked. Later stages are started first, so
+// slots that are in the pipeline already drain before new ones enter.
+static void pump(const std::shared_ptr<LoadBatch>& batch) {
+  if(batch->cancelled.load(std::memory_order_relaxed)) return;
+  for(int32_t s = (int32_t)LoadStage::Decode; s >= (int32_t)LoadStage::Io; s--) {
+    LoadStage stage = (LoadStage)s;
+    std::deque<uint32_t>& input = batch->queues[s];
+    std::deque<uint32_t>& output = batch->queues[s + 1];
+    while(batch->running[s] < stageConcurrency(stage) &&
+        output.size() + batch->running[s] < queueCapacity((LoadStage)(s + 1))) {
+      uint32_t i;
+      if(stage == LoadStage::Io) {
+        i = claimNextSlot(*batch);
+        if(i == UINT32_MAX) break;
+      } else {
+        if(input.empty()) break;
+        i = input.front();
+        input.pop_front();
+      }
+      batch->running[s]++;
+      ThreadPool::submit([batch, stage, i]() { runStage(batch, stage, i); }, TaskPriority::High);
+    }
+  }
+}
+
+static void runStage(const std::shared_ptr<LoadBatch>& batch, LoadStage stage, uint32_t i) {
+  LoadSlot& slot = batch->slots[i];
+  if(!batch->cancelled.load(std::memory_order_relaxed)) {
+    auto start = std::chrono::steady_clock::now();
+    switch(stage) {
+      case LoadStage::Io: runIo(slot); break;
+      case LoadStage::Parse: runParse(slot); break;
+      case LoadStage::Decode: runDecode(slot); break;
+      default: break;
+    }
+    recordStage(*batch, stage, start, 1);
+  }
+  std::lock_guard<std::mutex> lock(batch->mutex);
+  batch->running[(uint32_t)stage]--;
+  // cancel released the queued slots already, running ones release themselves
+  if(batch->cancelled.load(std::memory_order_relaxed)) {
+    releaseSlot(slot);
+    return;
+  }
+  batch->queues[(uint32_t)stage + 1].push_back(i);
+  pump(batch);
+}
+
+static void mergeSlot(LoadSlot& slot, LoadGeneration generation) {
+  SoundFile& track = TrackTable::get(slot.id);
+  // The loader only fills in the metadata, the path stays the interned one
+  slot.file.dirId = track.dirId;
+  slot.file.filenameId = track.filenameId;
+  track = std::move(slot.file);
+  // The row paints the placeholder until the texture is there
+  track.loaded = true;
+  slot.merged = true;
+  if(slot.pyramid.hash == THUMBNAIL_HASH_NONE) return;
+  // Another track may have uploaded the cover in an earlier frame
+  if(ThumbnailCache::getTexture(slot.pyramid.hash, ThumbnailLevel::Row).width != 0) {
+    uploadedHashes.emplace_back(slot.pyramid.hash);
+  }
+  textureWaits[slot.pyramid.hash].push_back({slot.id, generation});
+}
+
+static void resolveWaits(uint64_t hash, LfTexture thumbnail) {
+  auto it = textureWaits.find(hash);
+  if(it == textureWaits.end()) return;
+  LfTexture gridThumbnail = ThumbnailCache::getTexture(hash, ThumbnailLevel::Grid);
+  for(const TextureWait& wait : it->second) {
+    SoundFile& track = TrackTable::get(wait.id);
+    track.thumbnail = thumbnail;
+    track.gridThumbnail = gridThumbnail;
+  }
+  textureWaits.erase(it);
+}
+
+// Resolves the waits of the covers uploaded since the last call. Waits whose
+// cover is not claimed by any track anymore are orphaned, the track that
+// provided it was cancelled. Those tracks are loaded again to provide the
+// cover themselves.
+static void resolveTextureWaits(bool checkOrphans) {
+  for(uint64_t hash : uploadedHashes) {
+    LfTexture thumbnail = ThumbnailCache::getTexture(hash, ThumbnailLevel::Row);
+    if(thumbnail.width != 0) resolveWaits(hash, thumbnail);
+  }
+  uploadedHashes.clear();
+  if(!checkOrphans) return;
+
+  std::vector<TrackId> orphans;
+  for(auto it = textureWaits.begin(); it != textureWaits.end();) {
+    if(ThumbnailCache::isClaimed(it->first, ThumbnailLevel::Row)) {
+      ++it;
+      continue;
+    }
+    for(const TextureWait& wait : it->second) {
+      if(orphanRetries.insert(wait.id).second) {
+        TrackTable::get(wait.id).loaded = false;
+        orphans.emplace_back(wait.id);
+      }
+    }
+    it = textureWaits.erase(it);
+  }
+  if(!orphans.empty()) {
+    TrackLoader::load(orphans);
+  }
+}
+
+// Merges the metadata of the slots that left the Decode stage and uploads
+// their covers while the frame has budget left. Slots that did not fit stay
+// in the upload queue, so the stages before keep waiting for them. Returns
+// true if anything was merged or uploaded.
+// The queue stays in place while the covers are uploaded, pump keeps counting
+// its slots against the capacity. Tasks only append to it and only this
+// thread pops, so the uploaded prefix is popped afterwards.
+static bool mergeReadySlots(const std::shared_ptr<LoadBatch>& batch) {
+  std::vector<uint32_t> ready;
+  {
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    const std::deque<uint32_t>& queue = batch->queues[(uint32_t)LoadStage::Upload];
+    ready.assign(queue.begin(), queue.end());
+  }
+  if(ready.empty()) return false;
+
+  bool merged = false;
+  for(uint32_t i : ready) {
+    if(batch->slots[i].merged) continue;
+    mergeSlot(batch->slots[i], batch->generation);
+    merged = true;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint32_t uploaded = 0;
+  while(uploaded < ready.size() && ThumbnailCache::hasUploadBudget()) {
+    LoadSlot& slot = batch->slots[ready[uploaded++]];
+    // Tracks with the same cover share the uploaded textures
+    uploadedHashes.emplace_back(slot.pyramid.hash);
+    ThumbnailCache::upload(slot.pyramid);
+    slot.uploaded = true;
+  }
+  batch->uploadedCount += uploaded;
+  recordStage(*batch, LoadStage::Upload, start, uploaded);
+
+  std::lock_guard<std::mutex> lock(batch->mutex);
+  std::deque<uint32_t>& queue = batch->queues[(uint32_t)LoadStage::Upload];
+  queue.erase(queue.begin(), queue.begin() + std::min<size_t>(uploaded, queue.size()));
+  // The upload queue has room again
+  if(uploaded) pump(batch);
+  return merged || uploaded;
+}
+
+// Per task rates, the stage with the lowest rate per allowed task is the one
+// that holds up the others
+static void logThroughput(const LoadBatch& batch) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch.startTime).count();
+  LOG_INFO("Loaded %zu tracks in %.2fs.", batch.slots.size(), seconds);
+  for(uint32_t s = 0; s < LOAD_STAGE_COUNT; s++) {
+    double busy = batch.stats[s].busyNs.load() / 1e9;
+    uint32_t items = batch.stats[s].items.load();
+    LOG_INFO("  %-6s %8.0f tracks/s per task, %.2fs busy", stageNames[s], busy > 0.0 ? items / busy : 0.0, busy);
+  }
+}
+
+namespace TrackLoader {
+  LoadGeneration load(const std::vector<TrackId>& tracks) {
+    if(tracks.empty()) return LOAD_GENERATION_NONE;
+
+    auto batch = std::make_shared<LoadBatch>(tracks.size());
+    batch->generation = ++lastGeneration;
+    for(uint32_t i = 0; i < tracks.size(); i++) {
+      batch->slots[i].id = tracks[i];
+      SoundFile& track = TrackTable::get(tracks[i]);
+      batch->slots[i].path = track.path().string();
+      batch->slotIndex.emplace(tracks[i], i);
+      // The row paints the recorded colors while the cover goes through the stages
+      if(!track.placeholder.valid) {
+        track.placeholder = ThumbnailCache::findPlaceholder(batch->slots[i].path);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      pump(batch);
+    }
+    batches.emplace_back(std::move(batch));
+    // The new batch is focused by the next prioritize call
+    focusedTracks.clear();
+    return lastGeneration;
+  }
+
+  void cancel(LoadGeneration generation) {
+    auto it = std::find_if(batches.begin(), batches.end(),
+        [&](const auto& batch) { return batch->generation == generation; });
+    if(it == batches.end()) return;
+    LoadBatch& batch = **it;
+    {
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      batch.cancelled.store(true, std::memory_order_relaxed);
+      // Tracks that carry the pixels of their cover would never get it, they
+      // are loaded again with the playlist
+      for(const auto& slot : batch.slots) {
+        if(slot.merged && !slot.uploaded && slot.pyramid.levels[(uint32_t)ThumbnailLevel::Row].data) {
+          TrackTable::get(slot.id).loaded = false;
+        }
+      }
+      // Queued slots give their covers back right away, so a resume or
+      // another batch provides them instead of waiting for this one
+      for(uint32_t s = (uint32_t)LoadStage::Parse; s < LOAD_STAGE_COUNT; s++) {
+        for(uint32_t i : batch.queues[s]) {
+          releaseSlot(batch.slots[i]);
+        }
+        batch.queues[s].clear();
+      }
+    }
+    // Tracks of the batch that still wait for a cover are loaded again with
+    // the playlist as well
+    resolveTextureWaits(false);
+    for(auto waits = textureWaits.begin(); waits != textureWaits.end();) {
+      auto waitsEnd = std::remove_if(waits->second.begin(), waits->second.end(), [&](const TextureWait& wait) {
+          if(wait.generation != generation) return false;
+          TrackTable::get(wait.id).loaded = false;
+          return true;
+          });
+      waits->second.erase(waitsEnd, waits->second.end());
+      waits = waits->second.empty() ? textureWaits.erase(waits) : std::next(waits);
+    }
+    // The last task that holds the batch frees it
+    batches.erase(it);
+  }
+
+  bool poll() {
+    bool merged = false, finished = false;
+    for(auto it = batches.begin(); it != batches.end();) {
+      merged |= mergeReadySlots(*it);
+      if((*it)->uploadedCount == (*it)->slots.size()) {
+        logThroughput(**it);
+        it = batches.erase(it);
+        finished = true;
+      } else {
+        ++it;
+      }
+    }
+    bool released = levelsReleased.exchange(false);
+    if(!uploadedHashes.empty() || released) {
+      resolveTextureWaits(released);
+    }
+    // Written once per batch instead of once per merged track
+    if(finished) {
+      ThumbnailCache::saveIndex();
+    }
+    return merged;
+  }
+
+  void prioritize(const std::vector<TrackId>& tracks) {
+    // Only changes of the view reorder the work
+    if(tracks == focusedTracks) return;
+    focusedTracks = tracks;
+
+    for(auto& batch : batches) {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      // Slots that left the view go back to row order
+      batch->focus.clear();
+      for(auto it = tracks.rbegin(); it != tracks.rend(); ++it) {
+        auto slot = batch->slotIndex.find(*it);
+        if(slot == batch->slotIndex.end() || batch->slots[slot->second].claimed) continue;
+        batch->focus.emplace_back(slot->second);
+      }
+    }
+  }
+
+  bool isLoading() {
+    return !batches.empty();
+  }
+
+  bool isLoading(LoadGeneration generation) {
+    return std::any_of(batches.begin(), batches.end(),
+        [&](const auto& batch) { return batch->generation == generation; });
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "trackTable.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+// Identifies one load, generations are never reused
+typedef uint64_t LoadGeneration;
+#define LOAD_GENERATION_NONE 0
+
+// Loads the metadata and covers of tracks on the ThreadPool. Every track gets
+// a preallocated result slot that passes through the stages I/O (stat and
+// cached tiles), parse (tags), decode (cover) and upload (UI thread). The
+// queues between the stages are bounded, so decoded covers never pile up
+// faster than they are uploaded. The metadata of a slot is merged as soon as
+// it leaves the decode stage, so rows fill in while the rest of the playlist
+// is still loading. Covers are uploaded under the per-frame budget of the
+// ThumbnailCache and rows paint their placeholder until then. The throughput
+// of every stage is logged once a load finished.
+namespace TrackLoader {
+  // Runs next to loads that are still in flight. Returns LOAD_GENERATION_NONE
+  // if there is nothing to load.
+  LoadGeneration load(const std::vector<TrackId>& tracks);
+  // Tasks of the load stop at their next checkpoint and its results are
+  // dropped, tracks that were not merged yet stay unloaded
+  void cancel(LoadGeneration generation);
+
+  // Called by the UI thread every frame, merges every published slot. Returns
+  // true if tracks were merged into the TrackTable.
+  bool poll();
+
+  // Loads the given tracks before every other pending one, in the given
+  // order. Called every frame with the rows on screen, so work that scrolled
+  // out of view falls back to row order.
+  void prioritize(const std::vector<TrackId>& tracks);
+
+  bool isLoading();
+  bool isLoading(LoadGeneration generation);
+}
@@ -0,0 +1,58 @@
+#include "trackTable.hpp"
+#include "soundTagParser.hpp"
+
+#include <deque>
+#include <unordered_map>
+
+// A deque keeps references stable while tracks are added
+static std::deque<SoundFile> tracks;
+// Keyed by the directory and the filename handle, paths are never hashed
+static std::unordered_map<uint64_t, TrackId> ids;
+
+static uint64_t trackKey(PathId dir, StringId filename) {
+  return ((uint64_t)dir << 32) | filename;
+}
+
+namespace TrackTable {
+  TrackId intern(const std::filesystem::path& path) {
+    PathId dir = PathPool::intern(path.parent_path());
+    StringId filename = StringPool::intern(path.filename().string());
+    auto [it, inserted] = ids.try_emplace(trackKey(dir, filename), (TrackId)tracks.size());
+    if(inserted) {
+      SoundFile& track = tracks.emplace_back();
+      track.dirId = dir;
+      track.filenameId = filename;
+    }
+    return it->second;
+  }
+
+  TrackId find(const std::filesystem::path& path) {
+    PathId dir = PathPool::find(path.parent_path());
+    StringId filename = StringPool::find(path.filename().string());
+    if(dir == PATH_ID_NONE || filename == STRING_ID_NONE) return TRACK_ID_NONE;
+    auto it = ids.find(trackKey(dir, filename));
+    return it != ids.end() ? it->second : TRACK_ID_NONE;
+  }
+  SoundFile& get(TrackId id) {
+    return tracks[id];
+  }
+
+  uint32_t size() {
+    return (uint32_t)tracks.size();
+  }
+
+  SoundFile fromMetadata(const SoundMetadata& metadata) {
+    SoundFile file{};
+    file.duration = static_cast<int32_t>(metadata.duration);
+    file.artistId = StringPool::intern(metadata.artist);
+    file.titleId = StringPool::intern(metadata.title);
+    file.releaseYear = metadata.releaseYear;
+    return file;
+  }
+
+  SoundFile unloadable() {
+    SoundFile file{};
+    file.titleId = StringPool::intern("File cannot be loaded");
+    return file;
+  }
+}
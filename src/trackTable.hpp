@@ -0,0 +1,69 @@
+#pragma once
+
+#include "imageScaler.hpp"
+#include "stringPool.hpp"
+
+extern "C" {
+#include <leif/leif.h>
+}
+
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+
+typedef uint32_t TrackId;
+#define TRACK_ID_NONE UINT32_MAX
+
+struct SoundFile {
+  // Directory in the PathPool, the rest are handles into the StringPool
+  PathId dirId;
+  StringId filenameId, artistId, titleId;
+  uint32_t releaseYear;
+  int32_t duration;
+  LfTexture thumbnail, gridThumbnail;
+  ThumbnailPlaceholder placeholder;
+  // Metadata and thumbnails were loaded
+  bool loaded;
+
+  std::filesystem::path path() const {
+    return PathPool::get(dirId) / filename();
+  }
+  const std::string& filename() const {
+    return StringPool::get(filenameId);
+  }
+  const std::string& artist() const {
+    return StringPool::get(artistId);
+  }
+  const std::string& title() const {
+    return StringPool::get(titleId);
+  }
+
+  bool operator==(const SoundFile& other) const {
+    return dirId == other.dirId && filenameId == other.filenameId;
+  }
+};
+
+// Every unique file of the library is stored once and identified by a dense
+// ID, playlists are arrays of those IDs. A track that is part of several
+// playlists is loaded, parsed and textured once. Tracks are never removed,
+// so references and IDs stay valid for the whole session.
+// Only used from the UI thread.
+struct SoundMetadata;
+
+namespace TrackTable {
+  // Returns the ID of the track, adds an unloaded track if it is new
+  TrackId intern(const std::filesystem::path& path);
+
+  // TRACK_ID_NONE if the file was never interned
+  TrackId find(const std::filesystem::path& path);
+
+  SoundFile& get(TrackId id);
+
+  uint32_t size();
+
+  // Thread safe, the track of parsed tags without its path. Called from the
+  // loader tasks.
+  SoundFile fromMetadata(const SoundMetadata& metadata);
+  // Track of a file that does not exist
+  SoundFile unloadable();
+}
@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include <stdint.h>
+#include <string.h>
 
 namespace LyssaUtils {
   static std::string getCommandOutput(const std::string& cmd) {
@@ -82,6 +83,34 @@ namespace LyssaUtils {
       return 0;
     }
   }
+  // Fast non-cryptographic 64-bit hash, 8 bytes per step
+  static uint64_t hashBytes(const void* data, size_t size) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    auto rotl = [](uint64_t x, int32_t r) { return (x << r) | (x >> (64 - r)); };
+    const unsigned char* p = (const unsigned char*)data;
+
+    uint64_t hash = 0x27D4EB2F165667C5ull ^ (size * prime1);
+    while(size >= 8) {
+      uint64_t k;
+      memcpy(&k, p, sizeof(k));
+      hash ^= rotl(k * prime2, 31) * prime1;
+      hash = rotl(hash, 27) * prime1 + 0x85EBCA77C2B2AE63ull;
+      p += 8;
+      size -= 8;
+    }
+    while(size--) {
+      hash ^= (*p++) * prime1;
+      hash = rotl(hash, 11) * prime2;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime1;
+    hash ^= hash >> 32;
+    return hash;
+  }
   static std::string toLower(const std::string& str) {
     std::string result = str;
     std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c){ return std::tolower(c); });